@@ -0,0 +1,948 @@
+/* createfs.c - host-side builder for the ECE391 file system image
+ *
+ * Usage: createfs -i <directory> -o <image> [-x | -I] [-w [-n inodes] [-s blocks]] [-z] [-d] [-c]
+ *
+ * Every regular file in <directory> becomes a file (type 2) in the image,
+ * next to the "." directory entry and the "rtc" device entry.  Every
+ * subdirectory becomes a directory (type 1) whose inode holds a
+ * subdir_header_t, its dentries ("." and ".." first) and, past
+ * SUBDIR_INDEX_MIN entries, a hash index by name (FS_FEATURE_SUBDIRS);
+ * directories are laid out like files, so every option applies.  File data is
+ * laid out contiguously, one file after another, so every index node format
+ * describes each file with as few runs as possible:
+ *   default  legacy index nodes (length + 1023 data block numbers)
+ *   -x       extent index nodes (length + (start, count) runs),
+ *            sets FS_FEATURE_EXTENTS in the boot block
+ *   -I       index nodes with single and double indirect blocks,
+ *            sets FS_FEATURE_INDIRECT in the boot block; the indirect
+ *            blocks of a file are placed right before its data
+ *   -w       writable image (implies -x): an inode bitmap and a data block
+ *            bitmap follow the directory blocks, then -n spare inodes
+ *            (default 64) and -s spare data blocks (default 256) are left
+ *            free for the kernel to allocate (FS_FEATURE_WRITABLE)
+ *   -z       compress every 4KB block of a file with LZ4 (implies -x), files
+ *            that don't get at least one data block smaller are stored as is
+ *            (EXTENT_FLAG_LZ4, FS_FEATURE_LZ4); compressed files can't be
+ *            written or mapped by the kernel
+ *   -d       store identical data blocks once, the index nodes of every file
+ *            holding one point at the same block (not with -w, since the
+ *            kernel writes blocks in place); shared blocks split extents
+ *   -c       store a CRC32C of every index node and data block in a table
+ *            at the end of the image, the kernel checks them at mount
+ *            (FS_FEATURE_CHECKSUMS, not with -w for the same reason as -d)
+ * Entries that don't fit in the boot block go to chained directory blocks
+ * at the end of the image (FS_FEATURE_DIR_CHAIN).
+ *
+ * The structures below must match student-distrib/file_system.h.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FOUR_KB 4096
+#define MAX_NAME_LENGTH 32
+#define MAX_DIR_ENTRIES 63
+#define MAX_DATA_BLOCKS 1023
+#define MAX_EXTENTS 510
+#define MAX_DIRECT_BLOCKS 1020
+#define BLOCK_POINTERS 1024
+#define MAX_DENTRIES 1024
+#define MAX_FILES 16384					/* files and subdirectories in the whole tree */
+#define SUBDIR_INDEX_MIN 16				/* larger subdirectories get a hash index */
+
+#define FS_MAGIC 0x33394653
+#define FS_FEATURE_EXTENTS 0x1
+#define FS_FEATURE_INDIRECT 0x2
+#define FS_FEATURE_DIR_CHAIN 0x4
+#define FS_FEATURE_WRITABLE 0x8
+#define FS_FEATURE_LZ4 0x10
+#define FS_FEATURE_SUBDIRS 0x20
+#define FS_FEATURE_CHECKSUMS 0x40
+#define CRC32C_POLY 0x82F63B78
+#define EXTENT_FLAG_LZ4 0x1
+#define SUBDIR_MAGIC 0x52494453
+#define FNV_OFFSET_BASIS 0x811C9DC5
+#define FNV_PRIME 0x01000193
+#define BITS_PER_BLOCK (FOUR_KB*8)
+#define DEFAULT_SPARE_INODES 64
+#define DEFAULT_SPARE_BLOCKS 256
+#define EXTENT_MAGIC 0x544E5845
+#define INDIRECT_MAGIC 0x444E4901
+
+/* index node formats */
+#define FORMAT_LEGACY 0
+#define FORMAT_EXTENT 1
+#define FORMAT_INDIRECT 2
+
+#define TYPE_RTC 0
+#define TYPE_DIR 1
+#define TYPE_FILE 2
+
+typedef struct dir_entry{
+	char file_name[MAX_NAME_LENGTH];
+	uint32_t file_type;
+	uint32_t inode;
+	uint32_t reserved[6];
+} dentry_t;
+
+typedef struct boot_block{
+	uint32_t num_dir_entries;
+	uint32_t num_inodes;
+	uint32_t num_data_blocks;
+	uint32_t magic;
+	uint32_t features;
+	uint32_t dir_next;
+	uint32_t inode_bitmap;
+	uint32_t block_bitmap;
+	uint32_t checksum_table;
+	uint32_t reserved[7];
+	dentry_t dir_entries[MAX_DIR_ENTRIES];
+} boot_block_t;
+
+typedef struct dir_block{
+	uint32_t num_dir_entries;
+	uint32_t dir_next;
+	uint32_t reserved[14];
+	dentry_t dir_entries[MAX_DIR_ENTRIES];
+} dir_block_t;
+
+typedef struct subdir_header{
+	uint32_t magic;
+	uint32_t num_entries;
+	uint32_t hash_size;
+	uint32_t reserved[13];
+} subdir_header_t;
+
+typedef struct index_node{
+	uint32_t length;
+	uint32_t data_block[MAX_DATA_BLOCKS];
+} index_node_t;
+
+typedef struct extent{
+	uint32_t start;
+	uint32_t count;
+} extent_t;
+
+typedef struct extent_node{
+	uint32_t length;
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t num_extents;
+	extent_t extents[MAX_EXTENTS];
+} extent_node_t;
+
+typedef struct indirect_node{
+	uint32_t length;
+	uint32_t magic;
+	uint32_t single_indirect;
+	uint32_t double_indirect;
+	uint32_t data_block[MAX_DIRECT_BLOCKS];
+} indirect_node_t;
+
+/* LZ4 block format */
+#define LZ4_MIN_MATCH 4
+#define LZ4_RUN_MASK 0xF
+#define LZ4_LAST_LITERALS 5			/* a block always ends with this many literals */
+#define LZ4_MATCH_LIMIT 12			/* no match starts this close to the end */
+#define LZ4_HASH_BITS 12
+
+/* one input file or subdirectory */
+typedef struct input_file{
+	char name[MAX_NAME_LENGTH+1];
+	char* path;						/* the host path */
+	uint32_t type;					/* TYPE_FILE or TYPE_DIR */
+	int parent;						/* index of the subdirectory holding it, -1 for the root */
+	int first_child;				/* TYPE_DIR: the entries of a directory are contiguous in files[] */
+	int num_children;
+	uint8_t* data;
+	uint32_t length;
+	uint8_t* stored;				/* what goes into the data blocks, data unless compressed */
+	uint32_t stored_length;
+	uint32_t flags;					/* EXTENT_FLAG_* of the index node */
+	uint32_t meta_block;			/* first indirect block of an indirect index node */
+	uint32_t* block_map;			/* data block of every stored block */
+} input_file_t;
+
+/* one distinct data block, for -d */
+typedef struct block_hash{
+	uint64_t hash;
+	const uint8_t* data;			/* the stored bytes, NULL for an empty slot */
+	uint32_t size;					/* bytes in the block, the rest is zero */
+	uint32_t block;					/* data block in the image */
+} block_hash_t;
+
+static input_file_t files[MAX_FILES];
+static int num_files;
+static int num_root_files;			/* files[0 .. num_root_files) are in the root directory */
+static int num_subdirs;
+static uint32_t num_shared;			/* stored blocks that reuse another data block */
+
+/* static int compare_files()
+ * Task: order input files by name so images are reproducible
+ */
+static int compare_files(const void* a, const void* b){
+	return strcmp(((const input_file_t*)a)->name, ((const input_file_t*)b)->name);
+}
+
+/* static int read_file()
+ * Task: read a whole host file into memory
+ * Input : path----the host path
+ *		   file----filled with the data and length
+ * Output: 0 on success, -1 on failure
+ */
+static int read_file(const char* path, input_file_t* file){
+	FILE* fp = fopen(path, "rb");
+	long length;
+
+	if (fp==NULL){
+		perror(path);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	file->data = malloc(length>0 ? length : 1);
+	if (file->data==NULL || fread(file->data, 1, length, fp)!=(size_t)length){
+		fprintf(stderr, "%s: read failed\n", path);
+		fclose(fp);
+		return -1;
+	}
+	file->length = length;
+	file->stored = file->data;
+	file->stored_length = length;
+	file->flags = 0;
+	fclose(fp);
+	return 0;
+}
+
+/* static uint8_t* lz4_length()
+ * Task: write the extra bytes of a length that doesn't fit its nibble
+ */
+static uint8_t* lz4_length(uint8_t* op, uint32_t length){
+	for (length-=LZ4_RUN_MASK;length>=0xFF;length-=0xFF){
+		*op++ = 0xFF;
+	}
+	*op++ = length;
+	return op;
+}
+
+/* static uint8_t* lz4_sequence()
+ * Task: write one sequence: token, literals, and the match unless match_length is 0
+ */
+static uint8_t* lz4_sequence(uint8_t* op, const uint8_t* literals, uint32_t literal_length, uint32_t offset, uint32_t match_length){
+	uint8_t* token = op++;
+	uint32_t match = match_length ? match_length-LZ4_MIN_MATCH : 0;
+
+	*token = (literal_length<LZ4_RUN_MASK ? literal_length : LZ4_RUN_MASK) << 4;
+	if (literal_length>=LZ4_RUN_MASK){
+		op = lz4_length(op, literal_length);
+	}
+	memcpy(op, literals, literal_length);
+	op += literal_length;
+	if (match_length){
+		*op++ = offset & 0xFF;
+		*op++ = offset >> 8;
+		*token |= match<LZ4_RUN_MASK ? match : LZ4_RUN_MASK;
+		if (match>=LZ4_RUN_MASK){
+			op = lz4_length(op, match);
+		}
+	}
+	return op;
+}
+
+/* static uint32_t lz4_compress()
+ * Task: compress one block of at most 4KB into the LZ4 block format, greedy with a hash of 4-byte sequences
+ * Input : src, length----the data
+ *		   dst------------room for at least length+length/255+16 bytes
+ * Output: the length of the compressed block
+ */
+static uint32_t lz4_compress(const uint8_t* src, uint32_t length, uint8_t* dst){
+	int32_t table[1<<LZ4_HASH_BITS];
+	uint32_t ip = 0, anchor = 0, match, sequence, hash;
+	int32_t ref;
+	uint8_t* op = dst;
+
+	memset(table, 0xFF, sizeof(table));
+	while (ip+LZ4_MATCH_LIMIT<length){
+		memcpy(&sequence, src+ip, sizeof(sequence));
+		hash = (sequence*2654435761U) >> (32-LZ4_HASH_BITS);
+		ref = table[hash];
+		table[hash] = ip;
+		if (ref<0 || memcmp(src+ref, src+ip, LZ4_MIN_MATCH)!=0){
+			ip++;
+			continue;
+		}
+		match = LZ4_MIN_MATCH;
+		while (ip+match<length-LZ4_LAST_LITERALS && src[ref+match]==src[ip+match]){
+			match++;
+		}
+		op = lz4_sequence(op, src+anchor, ip-anchor, ip-ref, match);
+		ip += match;
+		anchor = ip;
+	}
+	op = lz4_sequence(op, src+anchor, length-anchor, 0, 0);
+	return op-dst;
+}
+
+/* static int compress_file()
+ * Task: replace what is stored for a file by its LZ4 stream: the offsets of the blocks in the
+ *		 stream, then every block compressed, or as is if it doesn't get smaller
+ *		 the file is left as is if the stream doesn't save a data block
+ * Output: 0 on success, -1 if out of memory
+ */
+static int compress_file(input_file_t* file){
+	uint32_t blocks = (file->length+FOUR_KB-1)/FOUR_KB;
+	uint32_t header = (blocks+1)*sizeof(uint32_t);
+	uint32_t k, size, packed;
+	uint32_t* offset;
+	uint8_t* stream;
+
+	if (blocks==0){
+		return 0;
+	}
+	stream = malloc(header+(size_t)blocks*(FOUR_KB+FOUR_KB/255+16));
+	if (stream==NULL){
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+	offset = (uint32_t*)stream;
+	offset[0] = header;
+	for (k=0;k<blocks;k++){
+		size = file->length-k*FOUR_KB<FOUR_KB ? file->length-k*FOUR_KB : FOUR_KB;
+		packed = lz4_compress(file->data+(size_t)k*FOUR_KB, size, stream+offset[k]);
+		if (packed>=size){
+			memcpy(stream+offset[k], file->data+(size_t)k*FOUR_KB, size);
+			packed = size;
+		}
+		offset[k+1] = offset[k]+packed;
+	}
+	if ((offset[blocks]+FOUR_KB-1)/FOUR_KB>=blocks){
+		free(stream);
+		return 0;
+	}
+	file->stored = stream;
+	file->stored_length = offset[blocks];
+	file->flags = EXTENT_FLAG_LZ4;
+	return 0;
+}
+
+/* static int scan_directory()
+ * Task: load every regular file of a host directory, then its subdirectories
+ *		 one after another, so the entries of every directory end up contiguous
+ * Input : dir------the host directory
+ *		   parent---index of its entry in files[], -1 for the input directory
+ * Output: 0 on success, -1 on failure
+ */
+static int scan_directory(const char* dir, int parent){
+	DIR* dp = opendir(dir);
+	struct dirent* de;
+	struct stat st;
+	char path[4096];
+	int first = num_files, count, i;
+
+	if (dp==NULL){
+		perror(dir);
+		return -1;
+	}
+	while ((de=readdir(dp))!=NULL){
+		if (strcmp(de->d_name, ".")==0 || strcmp(de->d_name, "..")==0){
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (stat(path, &st)!=0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))){
+			continue;
+		}
+		/* "." and "rtc" are added by the builder */
+		if (parent<0 ? num_files==MAX_DENTRIES-2 : num_files==MAX_FILES){
+			fprintf(stderr, "too many files, the %s holds %d entries\n", parent<0 ? "directory" : "tree", parent<0 ? MAX_DENTRIES : MAX_FILES);
+			closedir(dp);
+			return -1;
+		}
+		/* names longer than 32 chars are truncated, as the kernel does */
+		snprintf(files[num_files].name, sizeof(files[num_files].name), "%.*s", MAX_NAME_LENGTH, de->d_name);
+		files[num_files].parent = parent;
+		if (S_ISDIR(st.st_mode)){
+			/* the data is made by build_subdirs once the whole tree is known */
+			files[num_files].type = TYPE_DIR;
+			files[num_files].path = strdup(path);
+			num_subdirs++;
+		}
+		else{
+			files[num_files].type = TYPE_FILE;
+			if (read_file(path, &files[num_files])!=0){
+				closedir(dp);
+				return -1;
+			}
+		}
+		num_files++;
+	}
+	closedir(dp);
+
+	/* sorting only moves this directory's entries, nothing points at them yet */
+	count = num_files-first;
+	qsort(files+first, count, sizeof(files[0]), compare_files);
+	if (parent<0){
+		num_root_files = count;
+	}
+	else{
+		files[parent].first_child = first;
+		files[parent].num_children = count;
+	}
+	for (i=first;i<first+count;i++){
+		if (files[i].type==TYPE_DIR && scan_directory(files[i].path, i)!=0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* static uint32_t name_hash()
+ * Task: FNV-1a over a name, the hash the kernel probes subdirectory indexes with
+ */
+static uint32_t name_hash(const char* name){
+	uint32_t hash = FNV_OFFSET_BASIS;
+	uint32_t i, length = strnlen(name, MAX_NAME_LENGTH);
+
+	for (i=0;i<length;i++){
+		hash = (hash ^ (uint8_t)name[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+/* static int build_subdirs()
+ * Task: make the data of every subdirectory: header, dentries and hash index
+ * Output: 0 on success, -1 on failure
+ */
+static int build_subdirs(void){
+	subdir_header_t* header;
+	dentry_t* entries;
+	uint32_t* slots;
+	uint32_t num_entries, hash_size, k, slot;
+	size_t length;
+	int i;
+
+	for (i=0;i<num_files;i++){
+		if (files[i].type!=TYPE_DIR){
+			continue;
+		}
+		num_entries = files[i].num_children+2;
+		hash_size = 0;
+		if (num_entries>SUBDIR_INDEX_MIN){
+			/* at least twice the entries keeps probe chains short */
+			for (hash_size=1;hash_size<2*num_entries;hash_size<<=1);
+		}
+		length = sizeof(subdir_header_t)+num_entries*sizeof(dentry_t)+hash_size*sizeof(uint32_t);
+		header = calloc(1, length);
+		if (header==NULL){
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+		header->magic = SUBDIR_MAGIC;
+		header->num_entries = num_entries;
+		header->hash_size = hash_size;
+
+		/* inode k+1 is files[k], inode 0 stands for the root directory */
+		entries = (dentry_t*)(header+1);
+		memcpy(entries[0].file_name, ".", 1);
+		entries[0].file_type = TYPE_DIR;
+		entries[0].inode = 1+i;
+		memcpy(entries[1].file_name, "..", 2);
+		entries[1].file_type = TYPE_DIR;
+		entries[1].inode = files[i].parent<0 ? 0 : 1+files[i].parent;
+		for (k=2;k<num_entries;k++){
+			input_file_t* child = &files[files[i].first_child+k-2];
+			memcpy(entries[k].file_name, child->name, strnlen(child->name, MAX_NAME_LENGTH));
+			entries[k].file_type = child->type;
+			entries[k].inode = 1+files[i].first_child+k-2;
+		}
+
+		slots = (uint32_t*)(entries+num_entries);
+		for (k=0;k<num_entries && hash_size>0;k++){
+			slot = name_hash(entries[k].file_name) & (hash_size-1);
+			while (slots[slot]!=0){
+				slot = (slot+1) & (hash_size-1);
+			}
+			slots[slot] = k+1;
+		}
+
+		files[i].data = (uint8_t*)header;
+		files[i].length = length;
+		files[i].stored = files[i].data;
+		files[i].stored_length = length;
+		files[i].flags = 0;
+	}
+	return 0;
+}
+
+/* static void add_dentry()
+ * Task: append one directory entry to the boot block, or to the chained
+ *		 directory blocks once the boot block is full
+ */
+static void add_dentry(uint8_t* img, const char* name, uint32_t type, uint32_t inode){
+	boot_block_t* boot = (boot_block_t*)img;
+	dir_block_t* dir_block;
+	dentry_t* dentry;
+
+	if (boot->num_dir_entries<MAX_DIR_ENTRIES){
+		dentry = &boot->dir_entries[boot->num_dir_entries++];
+	}
+	else{
+		/* walk to the last directory block of the chain */
+		dir_block = (dir_block_t*)(img+(size_t)(1+boot->num_inodes+boot->dir_next)*FOUR_KB);
+		while (dir_block->num_dir_entries==MAX_DIR_ENTRIES){
+			dir_block = (dir_block_t*)(img+(size_t)(1+boot->num_inodes+dir_block->dir_next)*FOUR_KB);
+		}
+		dentry = &dir_block->dir_entries[dir_block->num_dir_entries++];
+	}
+	memcpy(dentry->file_name, name, strnlen(name, MAX_NAME_LENGTH));
+	dentry->file_type = type;
+	dentry->inode = inode;
+}
+
+/* static uint32_t indirect_blocks()
+ * Task: count the indirect blocks an indirect index node needs for a file
+ */
+static uint32_t indirect_blocks(uint32_t blocks){
+	if (blocks<=MAX_DIRECT_BLOCKS){
+		return 0;
+	}
+	blocks -= MAX_DIRECT_BLOCKS;
+	if (blocks<=BLOCK_POINTERS){
+		return 1;
+	}
+	blocks -= BLOCK_POINTERS;
+	/* single indirect + double indirect + its single indirect blocks */
+	return 2+(blocks+BLOCK_POINTERS-1)/BLOCK_POINTERS;
+}
+
+/* static uint64_t hash_block()
+ * Task: FNV-1a over a block padded with zeros to 4KB
+ */
+static uint64_t hash_block(const uint8_t* data, uint32_t size){
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	uint32_t i;
+
+	for (i=0;i<FOUR_KB;i++){
+		hash = (hash ^ (i<size ? data[i] : 0)) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+/* static int same_block()
+ * Task: compare two blocks padded with zeros to 4KB
+ */
+static int same_block(const uint8_t* a, uint32_t a_size, const uint8_t* b, uint32_t b_size){
+	const uint8_t* tail = a_size>b_size ? a : b;
+	uint32_t common = a_size<b_size ? a_size : b_size;
+	uint32_t longer = a_size>b_size ? a_size : b_size;
+
+	if (memcmp(a, b, common)!=0){
+		return 0;
+	}
+	for (;common<longer;common++){
+		if (tail[common]!=0){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* static uint32_t crc32c()
+ * Task: CRC32C of a buffer, bit by bit, as the kernel computes it
+ */
+static uint32_t crc32c(const uint8_t* data, uint32_t size){
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t i, k;
+
+	for (i=0;i<size;i++){
+		crc ^= data[i];
+		for (k=0;k<8;k++){
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		}
+	}
+	return ~crc;
+}
+
+/* static uint32_t count_extents()
+ * Task: count the runs of adjacent data blocks in a block map
+ */
+static uint32_t count_extents(const uint32_t* map, uint32_t blocks){
+	uint32_t k, extents = 0;
+
+	for (k=0;k<blocks;k++){
+		if (k==0 || map[k]!=map[k-1]+1){
+			extents++;
+		}
+	}
+	return extents;
+}
+
+/* static int64_t plan_blocks()
+ * Task: give every stored block of every file its data block, files are laid out one after
+ *		 another, the indirect blocks of a file right before its data;
+ *		 with dedup a block identical to one already placed reuses it
+ * Input : format----FORMAT_LEGACY, FORMAT_EXTENT or FORMAT_INDIRECT
+ *		   dedup-----1 to share identical blocks
+ * Output: the number of data blocks used, -1 on failure
+ */
+static int64_t plan_blocks(int format, int dedup){
+	block_hash_t* table = NULL;
+	uint32_t table_size = 1, total = 0, next_block = 0;
+	uint32_t i, k, blocks, size, slot;
+	uint64_t hash;
+	const uint8_t* block;
+
+	for (i=0;i<num_files;i++){
+		total += (files[i].stored_length+FOUR_KB-1)/FOUR_KB;
+	}
+	if (dedup){
+		while (table_size<2*total){
+			table_size *= 2;
+		}
+		table = calloc(table_size, sizeof(block_hash_t));
+		if (table==NULL){
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+	}
+
+	for (i=0;i<num_files;i++){
+		blocks = (files[i].stored_length+FOUR_KB-1)/FOUR_KB;
+		if (format==FORMAT_LEGACY && blocks>MAX_DATA_BLOCKS){
+			fprintf(stderr, "%s: too large for a legacy index node, use -x or -I\n", files[i].name);
+			free(table);
+			return -1;
+		}
+		if (format==FORMAT_INDIRECT){
+			if (blocks>MAX_DIRECT_BLOCKS+BLOCK_POINTERS+BLOCK_POINTERS*BLOCK_POINTERS){
+				fprintf(stderr, "%s: too large for an indirect index node\n", files[i].name);
+				free(table);
+				return -1;
+			}
+			files[i].meta_block = next_block;
+			next_block += indirect_blocks(blocks);
+		}
+		files[i].block_map = malloc((blocks>0 ? blocks : 1)*sizeof(uint32_t));
+		if (files[i].block_map==NULL){
+			fprintf(stderr, "out of memory\n");
+			free(table);
+			return -1;
+		}
+		for (k=0;k<blocks;k++){
+			block = files[i].stored+(size_t)k*FOUR_KB;
+			size = files[i].stored_length-k*FOUR_KB<FOUR_KB ? files[i].stored_length-k*FOUR_KB : FOUR_KB;
+			if (!dedup){
+				files[i].block_map[k] = next_block++;
+				continue;
+			}
+			hash = hash_block(block, size);
+			for (slot=hash&(table_size-1);table[slot].data!=NULL;slot=(slot+1)&(table_size-1)){
+				if (table[slot].hash==hash && same_block(table[slot].data, table[slot].size, block, size)){
+					break;
+				}
+			}
+			if (table[slot].data!=NULL){
+				files[i].block_map[k] = table[slot].block;
+				num_shared++;
+			}
+			else{
+				table[slot].hash = hash;
+				table[slot].data = block;
+				table[slot].size = size;
+				table[slot].block = next_block;
+				files[i].block_map[k] = next_block++;
+			}
+		}
+		if (format==FORMAT_EXTENT && count_extents(files[i].block_map, blocks)>MAX_EXTENTS){
+			fprintf(stderr, "%s: too many shared blocks for an extent index node, use -I or drop -d\n", files[i].name);
+			free(table);
+			return -1;
+		}
+	}
+	free(table);
+	return next_block;
+}
+
+/* static void set_bits()
+ * Task: mark the first count bits of a bitmap as in use
+ */
+static void set_bits(uint8_t* map, uint32_t count){
+	uint32_t i;
+
+	for (i=0;i<count;i++){
+		map[i/8] |= 1 << (i%8);
+	}
+}
+
+/* static int build_image()
+ * Task: lay out the boot block, index nodes, data blocks, directory blocks and bitmaps
+ * Input : image----the output path
+ *		   format---FORMAT_LEGACY, FORMAT_EXTENT or FORMAT_INDIRECT
+ *		   writable-1 to add bitmaps and spare inodes and blocks
+ *		   dedup----1 to store identical data blocks once
+ *		   checksums-1 to add the CRC32C table
+ *		   spare_inodes, spare_blocks----free inodes and data blocks of a writable image
+ * Output: 0 on success, -1 on failure
+ */
+static int build_image(const char* image, int format, int writable, int dedup, int checksums, uint32_t spare_inodes, uint32_t spare_blocks){
+	/* the data blocks hold what is stored for every file, its length is the uncompressed length */
+	uint32_t num_inodes = num_files + 1;		/* inode 0 is the empty inode of "." and "rtc" */
+	uint32_t num_data_blocks = 0;
+	uint32_t num_dir_blocks = 0;
+	uint32_t num_bitmap_blocks = 0;
+	uint32_t num_checksum_blocks = 0;
+	uint32_t used_blocks, total_blocks;
+	uint32_t i, k, blocks;
+	int64_t planned;
+	uint8_t* img;
+	uint8_t* data;
+	size_t img_size;
+	boot_block_t* boot;
+	FILE* fp;
+
+	planned = plan_blocks(format, dedup);
+	if (planned<0){
+		return -1;
+	}
+	num_data_blocks = planned;
+	/* entries past the boot block go to chained directory blocks after the file data,
+	   never at data block 0 since 0 ends the chain */
+	if (num_root_files+2>MAX_DIR_ENTRIES){
+		num_dir_blocks = (num_root_files+2-MAX_DIR_ENTRIES+MAX_DIR_ENTRIES-1)/MAX_DIR_ENTRIES;
+		if (num_data_blocks==0){
+			num_data_blocks = 1;
+		}
+	}
+
+	/* the checksum table covers the index nodes and every data block before it */
+	if (checksums){
+		num_checksum_blocks = (num_inodes+num_data_blocks+num_dir_blocks+BLOCK_POINTERS-1)/BLOCK_POINTERS;
+	}
+
+	/* the bitmaps come after the directory blocks, then the spare blocks */
+	used_blocks = num_data_blocks+num_dir_blocks+num_checksum_blocks;
+	total_blocks = used_blocks;
+	if (writable){
+		num_inodes += spare_inodes;
+		if (num_inodes>BITS_PER_BLOCK){
+			fprintf(stderr, "too many inodes for one inode bitmap block\n");
+			return -1;
+		}
+		do{
+			total_blocks = used_blocks+1+num_bitmap_blocks+spare_blocks;
+			num_bitmap_blocks = (total_blocks+BITS_PER_BLOCK-1)/BITS_PER_BLOCK;
+		} while (used_blocks+1+num_bitmap_blocks+spare_blocks!=total_blocks);
+		used_blocks += 1+num_bitmap_blocks;
+	}
+
+	img_size = (size_t)(1+num_inodes+total_blocks)*FOUR_KB;
+	img = calloc(1, img_size);
+	if (img==NULL){
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+	boot = (boot_block_t*)img;
+	data = img+(size_t)(1+num_inodes)*FOUR_KB;
+	boot->num_inodes = num_inodes;
+	boot->num_data_blocks = total_blocks;
+	if (format==FORMAT_EXTENT){
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_EXTENTS;
+	}
+	if (format==FORMAT_INDIRECT){
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_INDIRECT;
+	}
+	if (num_dir_blocks>0){
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_DIR_CHAIN;
+		boot->dir_next = num_data_blocks;
+		for (i=0;i+1<num_dir_blocks;i++){
+			((dir_block_t*)(data+(size_t)(num_data_blocks+i)*FOUR_KB))->dir_next = num_data_blocks+i+1;
+		}
+	}
+	if (num_subdirs>0){
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_SUBDIRS;
+	}
+	if (writable){
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_WRITABLE;
+		boot->inode_bitmap = num_data_blocks+num_dir_blocks;
+		boot->block_bitmap = boot->inode_bitmap+1;
+		set_bits(data+(size_t)boot->inode_bitmap*FOUR_KB, num_files+1);
+		for (i=0;i<num_bitmap_blocks;i++){
+			uint32_t first = i*BITS_PER_BLOCK;
+			if (used_blocks>first){
+				set_bits(data+(size_t)(boot->block_bitmap+i)*FOUR_KB, used_blocks-first>BITS_PER_BLOCK ? BITS_PER_BLOCK : used_blocks-first);
+			}
+		}
+	}
+	add_dentry(img, ".", TYPE_DIR, 0);
+	add_dentry(img, "rtc", TYPE_RTC, 0);
+
+	for (i=0;i<num_files;i++){
+		uint8_t* inode_ptr = img+(size_t)(1+1+i)*FOUR_KB;
+		blocks = (files[i].stored_length+FOUR_KB-1)/FOUR_KB;
+		if (files[i].parent<0){
+			add_dentry(img, files[i].name, files[i].type, 1+i);
+		}
+
+		if (format==FORMAT_EXTENT){
+			extent_node_t* node = (extent_node_t*)inode_ptr;
+			node->length = files[i].length;
+			node->magic = EXTENT_MAGIC;
+			node->flags = files[i].flags;
+			if (files[i].flags & EXTENT_FLAG_LZ4){
+				boot->magic = FS_MAGIC;
+				boot->features |= FS_FEATURE_LZ4;
+			}
+			for (k=0;k<blocks;k++){
+				if (k>0 && files[i].block_map[k]==files[i].block_map[k-1]+1){
+					node->extents[node->num_extents-1].count++;
+					continue;
+				}
+				node->extents[node->num_extents].start = files[i].block_map[k];
+				node->extents[node->num_extents].count = 1;
+				node->num_extents++;
+			}
+		}
+		else if (format==FORMAT_INDIRECT){
+			indirect_node_t* node = (indirect_node_t*)inode_ptr;
+			uint32_t meta_block = files[i].meta_block;
+			uint32_t* pointers;
+			node->length = files[i].length;
+			node->magic = INDIRECT_MAGIC;
+			for (k=0;k<blocks;k++){
+				if (k<MAX_DIRECT_BLOCKS){
+					node->data_block[k] = files[i].block_map[k];
+				}
+				else if (k<MAX_DIRECT_BLOCKS+BLOCK_POINTERS){
+					node->single_indirect = meta_block;
+					pointers = (uint32_t*)(data+(size_t)meta_block*FOUR_KB);
+					pointers[k-MAX_DIRECT_BLOCKS] = files[i].block_map[k];
+				}
+				else{
+					uint32_t d = k-MAX_DIRECT_BLOCKS-BLOCK_POINTERS;
+					/* meta_block+1 is the double indirect block, its single indirect blocks follow */
+					node->double_indirect = meta_block+1;
+					pointers = (uint32_t*)(data+(size_t)(meta_block+1)*FOUR_KB);
+					pointers[d/BLOCK_POINTERS] = meta_block+2+d/BLOCK_POINTERS;
+					pointers = (uint32_t*)(data+(size_t)(meta_block+2+d/BLOCK_POINTERS)*FOUR_KB);
+					pointers[d%BLOCK_POINTERS] = files[i].block_map[k];
+				}
+			}
+		}
+		else{
+			index_node_t* node = (index_node_t*)inode_ptr;
+			node->length = files[i].length;
+			for (k=0;k<blocks;k++){
+				node->data_block[k] = files[i].block_map[k];
+			}
+		}
+		/* a shared block is written again with the same bytes */
+		for (k=0;k<blocks;k++){
+			uint32_t size = files[i].stored_length-k*FOUR_KB<FOUR_KB ? files[i].stored_length-k*FOUR_KB : FOUR_KB;
+			memcpy(data+(size_t)files[i].block_map[k]*FOUR_KB, files[i].stored+(size_t)k*FOUR_KB, size);
+		}
+	}
+
+	if (checksums){
+		uint32_t covered = num_inodes+num_data_blocks+num_dir_blocks;
+		uint32_t* table = (uint32_t*)(data+(size_t)(num_data_blocks+num_dir_blocks)*FOUR_KB);
+		boot->magic = FS_MAGIC;
+		boot->features |= FS_FEATURE_CHECKSUMS;
+		boot->checksum_table = num_data_blocks+num_dir_blocks;
+		for (k=0;k<covered;k++){
+			table[k] = crc32c(img+(size_t)(1+k)*FOUR_KB, FOUR_KB);
+		}
+	}
+
+	fp = fopen(image, "wb");
+	if (fp==NULL || fwrite(img, 1, img_size, fp)!=img_size){
+		perror(image);
+		free(img);
+		return -1;
+	}
+	fclose(fp);
+	printf("%s: %u entries, %u subdirectories, %u inodes, %u data blocks (%u free, %u shared)\n", image, num_root_files+2, num_subdirs, num_inodes, boot->num_data_blocks, total_blocks-used_blocks, num_shared);
+	free(img);
+	return 0;
+}
+
+static void usage(const char* prog){
+	fprintf(stderr, "usage: %s -i <directory> -o <image> [-x | -I] [-w [-n inodes] [-s blocks]] [-z] [-d] [-c]\n", prog);
+	fprintf(stderr, "  -x   write extent-based index nodes\n");
+	fprintf(stderr, "  -I   write index nodes with indirect blocks\n");
+	fprintf(stderr, "  -w   writable image with bitmaps, implies -x\n");
+	fprintf(stderr, "  -n   spare inodes of a writable image (default %d)\n", DEFAULT_SPARE_INODES);
+	fprintf(stderr, "  -s   spare data blocks of a writable image (default %d)\n", DEFAULT_SPARE_BLOCKS);
+	fprintf(stderr, "  -z   compress files with LZ4 when it saves space, implies -x\n");
+	fprintf(stderr, "  -d   store identical data blocks once, not with -w\n");
+	fprintf(stderr, "  -c   store a CRC32C of every block for the kernel to check, not with -w\n");
+	exit(1);
+}
+
+int main(int argc, char** argv){
+	const char* input = NULL;
+	const char* output = NULL;
+	int format = FORMAT_LEGACY;
+	int writable = 0;
+	int compress = 0;
+	int dedup = 0;
+	int checksums = 0;
+	uint32_t spare_inodes = DEFAULT_SPARE_INODES;
+	uint32_t spare_blocks = DEFAULT_SPARE_BLOCKS;
+	int opt, i;
+
+	while ((opt=getopt(argc, argv, "i:o:xIwn:s:zdc"))!=-1){
+		switch (opt){
+			case 'i': input = optarg; break;
+			case 'o': output = optarg; break;
+			case 'x': format = FORMAT_EXTENT; break;
+			case 'I': format = FORMAT_INDIRECT; break;
+			case 'w': writable = 1; break;
+			case 'n': spare_inodes = strtoul(optarg, NULL, 0); break;
+			case 's': spare_blocks = strtoul(optarg, NULL, 0); break;
+			case 'z': compress = 1; break;
+			case 'd': dedup = 1; break;
+			case 'c': checksums = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (input==NULL || output==NULL){
+		usage(argv[0]);
+	}
+	if (writable && dedup){
+		fprintf(stderr, "-d can't be used with -w, the kernel would write shared blocks\n");
+		return 1;
+	}
+	if (writable && checksums){
+		fprintf(stderr, "-c can't be used with -w, the kernel would write checked blocks\n");
+		return 1;
+	}
+	if (writable || compress){
+		if (format==FORMAT_INDIRECT){
+			fprintf(stderr, "-w and -z need extent index nodes, they can't be used with -I\n");
+			return 1;
+		}
+		format = FORMAT_EXTENT;
+	}
+	if (scan_directory(input, -1)!=0 || build_subdirs()!=0){
+		return 1;
+	}
+	for (i=0;compress && i<num_files;i++){
+		if (compress_file(&files[i])!=0){
+			return 1;
+		}
+	}
+	if (build_image(output, format, writable, dedup, checksums, spare_inodes, spare_blocks)!=0){
+		return 1;
+	}
+	return 0;
+}
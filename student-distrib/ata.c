@@ -0,0 +1,430 @@
+/* ata.c - IDE/ATA driver, reads the file system image from the disk
+ *		   requests are queued and completed on IRQ 14, with bus-master DMA when the controller has it,
+ *		   read-aheads of the block cache stay in the queue without anyone waiting for them
+ */
+#include "ata.h"
+#include "lib.h"
+#include "i8259.h"
+#include "slab.h"
+
+block_dev_t ata_dev;
+
+static uint16_t bm_port;			// bus master registers, 0 if there is no DMA
+static prd_t prd_table[PRD_MAX] __attribute__((aligned (8)));
+static ata_request_t* queue_head;	// the request the drive is working on
+static ata_request_t* queue_tail;
+
+/* uint32_t pci_read()
+ * Task: read a dword of the PCI configuration space
+ * Input : dev, func----the device and function on bus 0
+ *		   reg----------the register offset
+ * Output: the value of the register
+ */
+static uint32_t pci_read(uint32_t dev, uint32_t func, uint32_t reg){
+	outl(PCI_ENABLE | (dev << 11) | (func << 8) | (reg & ~0x3), PCI_CONFIG_ADDRESS);
+	return inl(PCI_CONFIG_DATA);
+}
+
+/* void pci_write()
+ * Task: write a dword of the PCI configuration space
+ * Input : dev, func----the device and function on bus 0
+ *		   reg----------the register offset
+ *		   value--------the value to write
+ * Output: None
+ */
+static void pci_write(uint32_t dev, uint32_t func, uint32_t reg, uint32_t value){
+	outl(PCI_ENABLE | (dev << 11) | (func << 8) | (reg & ~0x3), PCI_CONFIG_ADDRESS);
+	outl(value, PCI_CONFIG_DATA);
+}
+
+/* uint16_t find_bus_master()
+ * Task: find the IDE controller on bus 0 and turn bus mastering on
+ * Input : None
+ * Output: the I/O port of the bus master registers, 0 if there is none
+ */
+static uint16_t find_bus_master(void){
+	uint32_t dev, func, bar;
+	
+	for (dev=0;dev<PCI_MAX_DEVICES;dev++){
+		for (func=0;func<PCI_MAX_FUNCTIONS;func++){
+			if ((pci_read(dev, func, PCI_REG_ID) & 0xFFFF) == 0xFFFF){
+				continue;		/* nothing there */
+			}
+			if ((pci_read(dev, func, PCI_REG_CLASS) >> 16) != PCI_CLASS_IDE){
+				continue;
+			}
+			bar = pci_read(dev, func, PCI_REG_BAR4);
+			if (!(bar & 0x1)){
+				return 0;		/* not an I/O bar */
+			}
+			pci_write(dev, func, PCI_REG_COMMAND, pci_read(dev, func, PCI_REG_COMMAND) | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+			return bar & PCI_BAR_IO_MASK;
+		}
+	}
+	return 0;
+}
+
+/* int32_t wait_not_busy()
+ * Task: wait until the drive is ready for a command
+ * Input : None
+ * Output: the status register
+ */
+static uint8_t wait_not_busy(void){
+	uint8_t status;
+	
+	do{
+		status = inb(ATA_IO_PORT + ATA_REG_STATUS);
+	} while (status & ATA_SR_BSY);
+	return status;
+}
+
+/* void pio_write_sector()
+ * Task: hand the next sector of a PIO write to the drive
+ * Input : req----the request at the head of the queue
+ * Output: None
+ */
+static void pio_write_sector(ata_request_t* req){
+	uint16_t* data = (uint16_t*)(req->buf + req->done*ATA_SECTOR_SIZE);
+	uint32_t i;
+	
+	while (!(inb(ATA_IO_PORT + ATA_REG_STATUS) & (ATA_SR_DRQ | ATA_SR_ERR)));
+	for (i=0;i<ATA_SECTOR_SIZE/2;i++){
+		outw(data[i], ATA_IO_PORT + ATA_REG_DATA);
+	}
+}
+
+/* void start_request()
+ * Task: send the request at the head of the queue to the drive
+ * Input : None
+ * Output: None
+ */
+static void start_request(void){
+	ata_request_t* req = queue_head;
+	uint32_t addr, end, count, i;
+	
+	if (req == NULL){
+		return;
+	}
+	wait_not_busy();
+	
+	if (bm_port != 0){
+		/* one descriptor per piece of the buffer that doesn't cross 64KB */
+		addr = (uint32_t)req->buf;
+		end = addr + req->sectors*ATA_SECTOR_SIZE;
+		for (i=0;addr<end;i++){
+			count = PRD_BOUNDARY - (addr & (PRD_BOUNDARY-1));
+			if (count > end-addr){
+				count = end-addr;
+			}
+			prd_table[i].addr = addr;
+			prd_table[i].count = (uint16_t)count;		/* 64KB is written as 0 */
+			prd_table[i].flags = 0;
+			addr += count;
+		}
+		prd_table[i-1].flags = PRD_EOT;
+		outl((uint32_t)prd_table, bm_port + BM_REG_PRDT);
+		outb(req->write ? 0 : BM_CMD_READ, bm_port + BM_REG_COMMAND);
+		outb(BM_SR_ERR | BM_SR_IRQ, bm_port + BM_REG_STATUS);	/* write 1 to clear */
+	}
+	
+	outb(ATA_DRIVE_LBA | ATA_DRIVE_SLAVE | ((req->lba >> 24) & 0x0F), ATA_IO_PORT + ATA_REG_DRIVE);
+	outb((uint8_t)req->sectors, ATA_IO_PORT + ATA_REG_COUNT);		/* 256 is written as 0 */
+	outb((uint8_t)req->lba, ATA_IO_PORT + ATA_REG_LBA0);
+	outb((uint8_t)(req->lba >> 8), ATA_IO_PORT + ATA_REG_LBA1);
+	outb((uint8_t)(req->lba >> 16), ATA_IO_PORT + ATA_REG_LBA2);
+	if (bm_port != 0){
+		outb(req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, ATA_IO_PORT + ATA_REG_COMMAND);
+		outb((req->write ? 0 : BM_CMD_READ) | BM_CMD_START, bm_port + BM_REG_COMMAND);
+	}
+	else if (req->write){
+		outb(ATA_CMD_WRITE_PIO, ATA_IO_PORT + ATA_REG_COMMAND);
+		pio_write_sector(req);
+	}
+	else{
+		outb(ATA_CMD_READ_PIO, ATA_IO_PORT + ATA_REG_COMMAND);
+	}
+}
+
+/* void finish_request()
+ * Task: the head of the queue is done, start the next one
+ * Input : status----ATA_DONE or ATA_FAILED
+ * Output: None
+ */
+static void finish_request(int32_t status){
+	ata_request_t* req = queue_head;
+	
+	queue_head = req->next;
+	if (queue_head == NULL){
+		queue_tail = NULL;
+	}
+	req->status = status;
+	if (req->io != NULL){
+		req->io->done(req->io, (status == ATA_DONE) ? 0 : -1);
+		kfree(req);
+	}
+	start_request();
+}
+
+/* void ata_complete()
+ * Task: check the drive for the request at the head of the queue, called on IRQ 14 or when polling
+ * Input : None
+ * Output: None
+ */
+static void ata_complete(void){
+	ata_request_t* req = queue_head;
+	uint8_t status, bm_status;
+	uint16_t* data;
+	uint32_t i;
+	
+	if (req == NULL){
+		inb(ATA_IO_PORT + ATA_REG_STATUS);		/* acknowledge a stray interrupt */
+		return;
+	}
+	
+	if (bm_port != 0){
+		bm_status = inb(bm_port + BM_REG_STATUS);
+		if (!(bm_status & BM_SR_IRQ)){
+			return;			/* still transferring */
+		}
+		outb(req->write ? 0 : BM_CMD_READ, bm_port + BM_REG_COMMAND);	/* stop the engine */
+		status = inb(ATA_IO_PORT + ATA_REG_STATUS);			/* acknowledge the drive */
+		outb(BM_SR_ERR | BM_SR_IRQ, bm_port + BM_REG_STATUS);
+		finish_request(((bm_status & BM_SR_ERR) || (status & ATA_SR_ERR)) ? ATA_FAILED : ATA_DONE);
+		return;
+	}
+	
+	/* PIO: the drive has one sector ready, or took one, on every interrupt */
+	status = inb(ATA_IO_PORT + ATA_REG_STATUS);
+	if (status & ATA_SR_BSY){
+		return;
+	}
+	if (status & ATA_SR_ERR){
+		finish_request(ATA_FAILED);
+		return;
+	}
+	if (req->write){
+		req->done++;
+		if (req->done == req->sectors){
+			finish_request(ATA_DONE);
+		}
+		else{
+			pio_write_sector(req);
+		}
+		return;
+	}
+	if (!(status & ATA_SR_DRQ)){
+		return;
+	}
+	data = (uint16_t*)(req->buf + req->done*ATA_SECTOR_SIZE);
+	for (i=0;i<ATA_SECTOR_SIZE/2;i++){
+		data[i] = (uint16_t)inw(ATA_IO_PORT + ATA_REG_DATA);
+	}
+	req->done++;
+	if (req->done == req->sectors){
+		finish_request(ATA_DONE);
+	}
+}
+
+/* void ata_poll()
+ * Task: finish requests without the interrupt, used while interrupts are off
+ * Input : None
+ * Output: None
+ */
+static void ata_poll(void){
+	uint32_t flags;
+	
+	cli_and_save(flags);
+	ata_complete();
+	restore_flags(flags);
+}
+
+/* void queue_request()
+ * Task: put a request at the end of the queue, the drive starts it at once if the queue was empty,
+ *		 called with interrupts off
+ * Input : req----the request
+ * Output: None
+ */
+static void queue_request(ata_request_t* req){
+	if (queue_tail != NULL){
+		queue_tail->next = req;
+	}
+	else{
+		queue_head = req;
+	}
+	queue_tail = req;
+	if (queue_head == req){
+		start_request();
+	}
+}
+
+/* int32_t ata_transfer()
+ * Task: queue one transfer and wait for it, other processes run meanwhile if interrupts are on
+ * Input : lba--------first sector
+ *		   sectors----number of sectors, at most ATA_MAX_SECTORS
+ *		   buf--------kernel buffer
+ *		   write------1 to write buf to the disk, 0 to read
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t ata_transfer(uint32_t lba, uint32_t sectors, uint8_t* buf, uint32_t write){
+	ata_request_t req;
+	uint32_t flags;
+	
+	req.lba = lba;
+	req.sectors = sectors;
+	req.done = 0;
+	req.buf = buf;
+	req.write = write;
+	req.status = ATA_PENDING;
+	req.io = NULL;
+	req.next = NULL;
+	
+	cli_and_save(flags);
+	queue_request(&req);
+	restore_flags(flags);
+	
+	/* IRQ 14 completes the request, unless interrupts are off */
+	while (req.status == ATA_PENDING){
+		if (!(flags & IF_FLAG)){
+			ata_poll();
+		}
+	}
+	return (req.status == ATA_DONE) ? 0 : -1;
+}
+
+/* int32_t ata_blocks()
+ * Task: transfer file system blocks, split into commands the drive accepts
+ * Input : block----first block
+ *		   count----number of blocks
+ *		   buf------kernel buffer
+ *		   write----1 to write buf to the disk, 0 to read
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t ata_blocks(uint32_t block, uint32_t count, uint8_t* buf, uint32_t write){
+	uint32_t lba = block*ATA_SECTORS_PER_BLOCK;
+	uint32_t sectors = count*ATA_SECTORS_PER_BLOCK;
+	uint32_t n;
+	
+	while (sectors>0){
+		n = (sectors > ATA_MAX_SECTORS) ? ATA_MAX_SECTORS : sectors;
+		if (ata_transfer(lba, n, buf, write) != 0){
+			return -1;
+		}
+		lba += n;
+		sectors -= n;
+		buf += n*ATA_SECTOR_SIZE;
+	}
+	return 0;
+}
+
+/* int32_t ata_read_blocks()
+ * Task: read_blocks of the ata device
+ * Input : block----first block
+ *		   count----number of blocks
+ *		   buf------kernel buffer
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t ata_read_blocks(uint32_t block, uint32_t count, uint8_t* buf){
+	return ata_blocks(block, count, buf, 0);
+}
+
+/* int32_t ata_read_async()
+ * Task: read_async of the ata device, the request goes behind those already queued
+ * Input : io----the blocks to read, at most ATA_MAX_SECTORS sectors
+ * Output: 0 once queued, -1 if it is too long or there is no memory for the request
+ */
+static int32_t ata_read_async(block_io_t* io){
+	ata_request_t* req;
+	uint32_t flags;
+	
+	if (io->count*ATA_SECTORS_PER_BLOCK > ATA_MAX_SECTORS){
+		return -1;
+	}
+	req = (ata_request_t*)kmalloc(sizeof(ata_request_t));
+	if (req == NULL){
+		return -1;
+	}
+	req->lba = io->block*ATA_SECTORS_PER_BLOCK;
+	req->sectors = io->count*ATA_SECTORS_PER_BLOCK;
+	req->done = 0;
+	req->buf = io->buf;
+	req->write = 0;
+	req->status = ATA_PENDING;
+	req->io = io;
+	req->next = NULL;
+	cli_and_save(flags);
+	queue_request(req);
+	restore_flags(flags);
+	return 0;
+}
+
+/* int32_t ata_write_blocks()
+ * Task: write_blocks of the ata device
+ * Input : block----first block
+ *		   count----number of blocks
+ *		   buf------kernel buffer
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t ata_write_blocks(uint32_t block, uint32_t count, const uint8_t* buf){
+	return ata_blocks(block, count, (uint8_t*)buf, 1);
+}
+
+/* void ata_interrupt_handler()
+ * Task: IRQ 14, the drive finished a transfer
+ * Input : None
+ * Output: None
+ */
+void ata_interrupt_handler(void){
+	ata_complete();
+	send_eoi(ATA_IRQ_NUM);
+}
+
+/* int32_t ata_init()
+ * Task: find the drive holding the image and fill ata_dev
+ * Input : None
+ * Output: success return 0, -1 if there is no drive
+ */
+int32_t ata_init(void){
+	uint16_t identify[ATA_IDENTIFY_WORDS];
+	uint8_t status;
+	uint32_t i;
+	
+	queue_head = NULL;
+	queue_tail = NULL;
+	
+	/* IDENTIFY, polled */
+	outb(ATA_DRIVE_LBA | ATA_DRIVE_SLAVE, ATA_IO_PORT + ATA_REG_DRIVE);
+	outb(0, ATA_IO_PORT + ATA_REG_COUNT);
+	outb(0, ATA_IO_PORT + ATA_REG_LBA0);
+	outb(0, ATA_IO_PORT + ATA_REG_LBA1);
+	outb(0, ATA_IO_PORT + ATA_REG_LBA2);
+	outb(ATA_CMD_IDENTIFY, ATA_IO_PORT + ATA_REG_COMMAND);
+	if (inb(ATA_IO_PORT + ATA_REG_STATUS) == 0){
+		return -1;			/* no drive */
+	}
+	status = wait_not_busy();
+	if (inb(ATA_IO_PORT + ATA_REG_LBA1) != 0 || inb(ATA_IO_PORT + ATA_REG_LBA2) != 0){
+		return -1;			/* not an ATA drive */
+	}
+	while (!(status & (ATA_SR_DRQ | ATA_SR_ERR))){
+		status = inb(ATA_IO_PORT + ATA_REG_STATUS);
+	}
+	if (status & ATA_SR_ERR){
+		return -1;
+	}
+	for (i=0;i<ATA_IDENTIFY_WORDS;i++){
+		identify[i] = (uint16_t)inw(ATA_IO_PORT + ATA_REG_DATA);
+	}
+	
+	bm_port = find_bus_master();
+	
+	ata_dev.base = NULL;
+	ata_dev.num_blocks = (identify[ATA_IDENTIFY_LBA_SECTORS] | (identify[ATA_IDENTIFY_LBA_SECTORS+1] << 16)) / ATA_SECTORS_PER_BLOCK;
+	ata_dev.read_blocks = ata_read_blocks;
+	ata_dev.write_blocks = ata_write_blocks;
+	ata_dev.read_async = ata_read_async;
+	ata_dev.poll = ata_poll;
+	
+	outb(0, ATA_CTRL_PORT);		/* drive interrupts on */
+	enable_irq(ATA_IRQ_NUM);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/* ata.h - Defines for ata.c
+ *		   used to read the file system image from an IDE disk
+ */
+
+#ifndef _ATA_H
+#define _ATA_H
+
+#include "types.h"
+#include "block_cache.h"
+
+/* primary channel of the IDE controller */
+#define ATA_IO_PORT 0x1F0
+#define ATA_CTRL_PORT 0x3F6
+#define ATA_IRQ_NUM 14
+#define ATA_IDT_ENTRY 0x2E
+
+/* task file registers, offsets from ATA_IO_PORT */
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_COUNT 2
+#define ATA_REG_LBA0 3
+#define ATA_REG_LBA1 4
+#define ATA_REG_LBA2 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7
+#define ATA_REG_COMMAND 7
+
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_SR_ERR 0x01
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_BSY 0x80
+
+#define ATA_DRIVE_LBA 0xE0			// LBA addressing, master drive
+#define ATA_DRIVE_SLAVE 0x10		// the image is on the slave drive (qemu -hdb)
+#define ATA_SECTOR_SIZE 512
+#define ATA_SECTORS_PER_BLOCK (BLOCK_SIZE/ATA_SECTOR_SIZE)
+#define ATA_MAX_SECTORS 128			// sectors in one command, 64KB
+#define ATA_IDENTIFY_WORDS 256
+#define ATA_IDENTIFY_LBA_SECTORS 60	// word holding the number of LBA28 sectors
+
+/* bus master registers, offsets from BAR4 of the IDE controller */
+#define BM_REG_COMMAND 0
+#define BM_REG_STATUS 2
+#define BM_REG_PRDT 4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08			// the device writes to memory
+#define BM_SR_ERR 0x02
+#define BM_SR_IRQ 0x04
+#define PRD_EOT 0x8000				// last entry of the table
+#define PRD_MAX 2					// a 64KB request crosses at most one 64KB boundary
+#define PRD_BOUNDARY 0x10000		// an entry can't cross 64KB
+
+/* PCI configuration space */
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_ENABLE 0x80000000
+#define PCI_MAX_DEVICES 32
+#define PCI_MAX_FUNCTIONS 8
+#define PCI_REG_ID 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_CLASS 0x08
+#define PCI_REG_BAR4 0x20
+#define PCI_CLASS_IDE 0x0101		// mass storage, IDE
+#define PCI_CMD_IO 0x01
+#define PCI_CMD_BUS_MASTER 0x04
+#define PCI_BAR_IO_MASK 0xFFFC
+
+/* request status */
+#define ATA_PENDING 1
+#define ATA_DONE 0
+#define ATA_FAILED -1
+
+/* new struct for one entry of the physical region descriptor table */
+typedef struct prd{
+	uint32_t addr;					// physical address of the buffer
+	uint16_t count;					// bytes, 0 means 64KB
+	uint16_t flags;
+} __attribute__((packed)) prd_t;
+
+/* new struct for one transfer waiting in the request queue */
+typedef struct ata_request{
+	uint32_t lba;
+	uint32_t sectors;
+	uint32_t done;					// sectors already transferred (PIO)
+	uint32_t write;					// 1->write buf to the disk, 0->read
+	uint8_t* buf;					// kernel memory, mapped 1:1
+	volatile int32_t status;
+	block_io_t* io;					// a read-ahead nobody waits for, finished by done, NULL otherwise
+	struct ata_request* next;
+} ata_request_t;
+
+extern block_dev_t ata_dev;
+
+extern int32_t ata_init(void);
+extern void ata_interrupt_handler(void);
+
+#endif /* _ATA_H */
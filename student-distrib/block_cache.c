@@ -0,0 +1,429 @@
+/* block_cache.c - every block of the file system images is read through here,
+ *				   a memory-resident image is used in place, other devices go through one LRU of 4KB buffers
+ */
+#include "block_cache.h"
+#include "lib.h"
+
+block_stats_t block_stats;
+
+static block_buf_t buffers[BLOCK_CACHE_SIZE];
+static uint8_t buffer_data[BLOCK_CACHE_SIZE][BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static block_buf_t* lru_head;		// most recently used
+static block_buf_t* lru_tail;		// least recently used, reused first
+static uint32_t num_dirty;
+static block_io_t ios[READ_AHEAD_IOS];
+
+/* void lru_remove()
+ * Task: take a buffer out of the LRU list
+ * Input : buf----the buffer
+ * Output: None
+ */
+static void lru_remove(block_buf_t* buf){
+	if (buf->prev != NULL){
+		buf->prev->next = buf->next;
+	}
+	else{
+		lru_head = buf->next;
+	}
+	if (buf->next != NULL){
+		buf->next->prev = buf->prev;
+	}
+	else{
+		lru_tail = buf->prev;
+	}
+}
+
+/* void lru_push()
+ * Task: put a buffer at the most recently used end of the LRU list
+ * Input : buf----the buffer
+ * Output: None
+ */
+static void lru_push(block_buf_t* buf){
+	buf->prev = NULL;
+	buf->next = lru_head;
+	if (lru_head != NULL){
+		lru_head->prev = buf;
+	}
+	lru_head = buf;
+	if (lru_tail == NULL){
+		lru_tail = buf;
+	}
+}
+
+/* block_buf_t* find()
+ * Task: find the buffer holding a block or being filled with it, doesn't wait
+ * Input : dev------the device
+ *		   block----the block number
+ * Output: the buffer, NULL if the block isn't cached
+ */
+static block_buf_t* find(block_dev_t* dev, uint32_t block){
+	block_buf_t* buf;
+	
+	for (buf=lru_head;buf!=NULL;buf=buf->next){
+		if ((buf->valid || buf->busy) && buf->dev == dev && buf->block == block){
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+/* block_buf_t* lookup()
+ * Task: find the buffer holding a block, waits if another process or a read-ahead is reading it
+ * Input : dev------the device
+ *		   block----the block number
+ * Output: the buffer, NULL if the block isn't cached
+ */
+static block_buf_t* lookup(block_dev_t* dev, uint32_t block){
+	block_buf_t* buf = find(dev, block);
+	
+	if (buf == NULL){
+		return NULL;
+	}
+	while (buf->busy){
+		if (dev->poll != NULL){
+			dev->poll();
+		}
+	}
+	return (buf->valid && buf->dev == dev && buf->block == block) ? buf : NULL;
+}
+
+/* int32_t write_back()
+ * Task: write a dirty buffer to the device
+ * Input : buf----the buffer, marked busy by the caller
+ * Output: success return 0, otherwise return -1 and the buffer stays dirty
+ */
+static int32_t write_back(block_buf_t* buf){
+	if (buf->dev->write_blocks == NULL || buf->dev->write_blocks(buf->block, 1, buf->data) != 0){
+		return -1;
+	}
+	buf->dirty = 0;
+	num_dirty--;
+	block_stats.writes++;
+	return 0;
+}
+
+/* block_buf_t* fill()
+ * Task: read a block from the device into the least recently used buffer nobody pinned,
+ *		 the device may let other processes run until the read is done
+ * Input : dev------the device
+ *		   block----the block number
+ * Output: the buffer, now the most recently used and pinned once, NULL if the device failed
+ *		   or every buffer is busy or pinned
+ */
+static block_buf_t* fill(block_dev_t* dev, uint32_t block){
+	block_buf_t* buf;
+	uint32_t flags;
+	
+	cli_and_save(flags);
+	for (buf=lru_tail;buf!=NULL && (buf->busy || buf->pins);buf=buf->prev);
+	if (buf == NULL){
+		restore_flags(flags);
+		return NULL;
+	}
+	lru_remove(buf);
+	lru_push(buf);
+	buf->busy = 1;
+	buf->pins = 1;
+	restore_flags(flags);
+	
+	/* a dirty victim is written back before it is reused */
+	if (buf->dirty && write_back(buf) != 0){
+		buf->pins = 0;
+		buf->busy = 0;
+		return NULL;
+	}
+	buf->dev = dev;
+	buf->block = block;
+	buf->valid = 0;
+	
+	if (dev->read_blocks(block, 1, buf->data) == 0){
+		buf->valid = 1;
+	}
+	else{
+		buf->pins = 0;
+	}
+	buf->busy = 0;
+	return buf->valid ? buf : NULL;
+}
+
+/* block_buf_t* take_run()
+ * Task: find count buffers next to each other in the cache, none busy, dirty or pinned, so one read
+ *		 fills them all; of those runs, the one whose most recently used buffer is the oldest
+ *		 must be called with interrupts off
+ * Input : count----the number of buffers
+ * Output: the first buffer of the run, NULL if there is none
+ */
+static block_buf_t* take_run(uint32_t count){
+	uint32_t age[BLOCK_CACHE_SIZE];
+	uint32_t i, j, n = 0, newest, best_age = 0;
+	block_buf_t* best = NULL;
+	block_buf_t* buf;
+	
+	/* 0 is the most recently used */
+	for (buf=lru_head;buf!=NULL;buf=buf->next){
+		age[buf - buffers] = n++;
+	}
+	for (i=0;i+count<=BLOCK_CACHE_SIZE;i++){
+		newest = BLOCK_CACHE_SIZE;
+		for (j=i;j<i+count && !buffers[j].busy && !buffers[j].dirty && !buffers[j].pins;j++){
+			if (age[j] < newest){
+				newest = age[j];
+			}
+		}
+		if (j == i+count && (best == NULL || newest > best_age)){
+			best = &buffers[i];
+			best_age = newest;
+		}
+	}
+	return best;
+}
+
+/* void read_done()
+ * Task: a read-ahead finished, its buffers can be used
+ * Input : io-------the request
+ *		   status---0 on success
+ * Output: None
+ */
+static void read_done(block_io_t* io, int32_t status){
+	uint32_t i;
+	
+	for (i=0;i<io->count;i++){
+		io->first[i].valid = (status == 0);
+		io->first[i].busy = 0;
+	}
+	io->used = 0;
+}
+
+/* void block_cache_init()
+ * Task: empty the cache, done once before any device is read
+ * Input : None
+ * Output: None
+ */
+void block_cache_init(void){
+	uint32_t i;
+	
+	lru_head = NULL;
+	lru_tail = NULL;
+	for (i=0;i<BLOCK_CACHE_SIZE;i++){
+		buffers[i].valid = 0;
+		buffers[i].busy = 0;
+		buffers[i].dirty = 0;
+		buffers[i].pins = 0;
+		buffers[i].data = buffer_data[i];
+		lru_push(&buffers[i]);
+	}
+	for (i=0;i<READ_AHEAD_IOS;i++){
+		ios[i].used = 0;
+	}
+	memset(&block_stats, 0, sizeof(block_stats));
+	num_dirty = 0;
+}
+
+/* void block_cache_forget()
+ * Task: write back and drop every buffer of a device, before the device is used for another image
+ * Input : dev----the device
+ * Output: None
+ */
+void block_cache_forget(block_dev_t* dev){
+	block_buf_t* buf;
+	
+	block_flush();
+	for (buf=lru_head;buf!=NULL;buf=buf->next){
+		/* a read-ahead still in flight would fill the buffer with the old image */
+		while (buf->dev == dev && buf->busy){
+			if (dev->poll != NULL){
+				dev->poll();
+			}
+		}
+		if (buf->dev == dev && !buf->dirty && !buf->pins){
+			buf->valid = 0;
+		}
+	}
+}
+
+/* uint8_t* bread()
+ * Task: get the content of a block, for a cached device the buffer is pinned so it keeps the
+ *		 block even if the caller is preempted, every bread that doesn't fail needs a brelse
+ * Input : dev------the device
+ *		   block----the block number
+ * Output: the address of the block, NULL if it doesn't exist or can't be read
+ */
+uint8_t* bread(block_dev_t* dev, uint32_t block){
+	block_buf_t* buf;
+	uint32_t flags;
+	
+	if (dev == NULL || block >= dev->num_blocks){
+		return NULL;
+	}
+	if (dev->base != NULL){
+		block_stats.hits++;
+		return dev->base + block*BLOCK_SIZE;
+	}
+	
+	/* the buffer may be reused between lookup and the pin, it is looked up again then */
+	while ((buf = lookup(dev, block)) != NULL){
+		cli_and_save(flags);
+		if (buf->valid && buf->dev == dev && buf->block == block){
+			buf->pins++;
+			lru_remove(buf);
+			lru_push(buf);
+			restore_flags(flags);
+			block_stats.hits++;
+			return buf->data;
+		}
+		restore_flags(flags);
+	}
+	block_stats.misses++;
+	buf = fill(dev, block);
+	return (buf == NULL) ? NULL : buf->data;
+}
+
+/* void brelse()
+ * Task: the caller of bread is done with the block, once nobody pins it the buffer can be reused
+ * Input : data----the address bread returned, NULL and blocks of a memory-resident image are ignored
+ * Output: None
+ */
+void brelse(const void* data){
+	block_buf_t* buf;
+	uint32_t flags;
+	
+	if ((const uint8_t*)data < buffer_data[0] || (const uint8_t*)data >= buffer_data[BLOCK_CACHE_SIZE]){
+		return;
+	}
+	buf = &buffers[((const uint8_t*)data - buffer_data[0]) / BLOCK_SIZE];
+	cli_and_save(flags);
+	if (buf->pins > 0){
+		buf->pins--;
+	}
+	restore_flags(flags);
+}
+
+/* void bdirty()
+ * Task: mark a block changed after writing to the address bread returned, must be called
+ *		 before brelse, once enough blocks are dirty they are all written back
+ * Input : dev------the device
+ *		   block----the block number
+ * Output: None
+ */
+void bdirty(block_dev_t* dev, uint32_t block){
+	block_buf_t* buf;
+	
+	/* a memory-resident image is changed in place */
+	if (dev == NULL || dev->base != NULL){
+		return;
+	}
+	for (buf=lru_head;buf!=NULL;buf=buf->next){
+		if (buf->valid && buf->dev == dev && buf->block == block){
+			if (!buf->dirty){
+				buf->dirty = 1;
+				num_dirty++;
+			}
+			break;
+		}
+	}
+	if (num_dirty >= DIRTY_FLUSH){
+		block_flush();
+	}
+}
+
+/* void block_flush()
+ * Task: write every dirty block back to its device, in block order so the writes are sequential
+ * Input : None
+ * Output: None
+ */
+void block_flush(void){
+	block_buf_t* buf;
+	block_buf_t* next;
+	uint32_t flags;
+	
+	while (num_dirty > 0){
+		/* the dirty buffer with the lowest device and block number that nobody is using */
+		cli_and_save(flags);
+		next = NULL;
+		for (buf=lru_head;buf!=NULL;buf=buf->next){
+			if (buf->dirty && !buf->busy && (next == NULL || buf->dev < next->dev || (buf->dev == next->dev && buf->block < next->block))){
+				next = buf;
+			}
+		}
+		if (next == NULL){
+			restore_flags(flags);
+			return;
+		}
+		next->busy = 1;
+		restore_flags(flags);
+		
+		if (write_back(next) != 0){
+			next->busy = 0;
+			return;
+		}
+		next->busy = 0;
+	}
+}
+
+/* void block_read_ahead()
+ * Task: start reading blocks that are about to be needed, before they are asked for, every run of
+ *		 blocks that isn't cached is one request into buffers next to each other; it doesn't wait
+ *		 unless the device can't queue requests, bread waits for a block still on its way
+ * Input : dev------the device
+ *		   block----the first block
+ *		   count----the number of blocks
+ * Output: None
+ */
+void block_read_ahead(block_dev_t* dev, uint32_t block, uint32_t count){
+	block_buf_t* first;
+	block_io_t* io;
+	uint32_t i, n, flags;
+	
+	/* a memory-resident image has nothing to read, and never take over the whole cache */
+	if (dev == NULL || dev->base != NULL || block >= dev->num_blocks){
+		return;
+	}
+	if (count > BLOCK_CACHE_SIZE/2){
+		count = BLOCK_CACHE_SIZE/2;
+	}
+	if (count > dev->num_blocks - block){
+		count = dev->num_blocks - block;
+	}
+	while (count > 0){
+		cli_and_save(flags);
+		for (;count>0 && find(dev, block)!=NULL;block++,count--);
+		for (n=0;n<count && n<READ_AHEAD_RUN && find(dev, block+n)==NULL;n++);
+		
+		/* a free request, and the run shrinks until the cache has room for it */
+		for (io=NULL,i=0;i<READ_AHEAD_IOS && io==NULL;i++){
+			if (!ios[i].used){
+				io = &ios[i];
+			}
+		}
+		first = NULL;
+		while (io != NULL && n > 0 && (first = take_run(n)) == NULL){
+			n /= 2;
+		}
+		if (first == NULL){
+			restore_flags(flags);
+			return;
+		}
+		for (i=0;i<n;i++){
+			lru_remove(&first[i]);
+			lru_push(&first[i]);
+			first[i].busy = 1;
+			first[i].valid = 0;
+			first[i].dev = dev;
+			first[i].block = block+i;
+		}
+		io->used = 1;
+		io->block = block;
+		io->count = n;
+		io->buf = first->data;
+		io->first = first;
+		io->done = read_done;
+		restore_flags(flags);
+		
+		if (dev->read_async == NULL || dev->read_async(io) != 0){
+			read_done(io, dev->read_blocks(block, n, io->buf));
+		}
+		block_stats.read_ahead += n;
+		block += n;
+		count -= n;
+	}
+}
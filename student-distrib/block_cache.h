@@ -0,0 +1,69 @@
+/* block_cache.h - Defines for block_cache.c
+ *				   used to read the blocks of the file system images
+ */
+
+#ifndef _BLOCK_CACHE_H
+#define _BLOCK_CACHE_H
+
+#include "types.h"
+
+#define BLOCK_SIZE 4096
+#define BLOCK_CACHE_SIZE 32			// 4KB buffers for devices that aren't memory resident
+#define READ_AHEAD_MIN 2			// blocks read ahead once a file is read sequentially
+#define READ_AHEAD_MAX 32			// the window doubles on every sequential read up to this
+#define DIRTY_FLUSH 16				// dirty buffers kept before they are written back together
+#define READ_AHEAD_IOS 4			// read-ahead requests a device may have in flight
+#define READ_AHEAD_RUN 8			// blocks in one request, a longer run leaves no room for the blocks in use
+
+/* new struct for a read the device finishes on its own, the cache owns it until done is called */
+typedef struct block_io{
+	uint32_t block;
+	uint32_t count;
+	uint8_t* buf;					// count blocks, one after the other
+	void (*done)(struct block_io* io, int32_t status);	// 0 on success, may be called from an interrupt
+	struct block_buf* first;		// the buffers being filled, next to each other in the cache
+	uint32_t used;					// 1->in flight, 0->free
+} block_io_t;
+
+/* new struct to describe the device holding the image */
+typedef struct block_dev{
+	uint8_t* base;					// memory-resident image: blocks are used in place, NULL otherwise
+	uint32_t num_blocks;
+	int32_t (*read_blocks)(uint32_t block, uint32_t count, uint8_t* buf);	// 0 on success, other devices only
+	int32_t (*write_blocks)(uint32_t block, uint32_t count, const uint8_t* buf);	// 0 on success, other devices only
+	int32_t (*read_async)(block_io_t* io);	// 0 once queued, may be NULL, read_blocks is used then
+	void (*poll)(void);				// finish pending requests while interrupts are off, may be NULL
+} block_dev_t;
+
+/* new struct for one cached block, the buffers form an LRU list shared by every device */
+typedef struct block_buf{
+	block_dev_t* dev;				// the device the block belongs to
+	uint32_t block;
+	uint32_t valid;					// 1->holds block, 0->empty
+	volatile uint32_t busy;			// 1->being read from or written to the device
+	uint32_t dirty;					// 1->changed since it was read
+	uint32_t pins;					// bread callers that haven't called brelse, it isn't reused while > 0
+	uint8_t* data;
+	struct block_buf* prev;			// towards the most recently used
+	struct block_buf* next;			// towards the least recently used
+} block_buf_t;
+
+/* new struct to count how well the cache works */
+typedef struct block_stats{
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t read_ahead;			// blocks read before they were asked for
+	uint32_t writes;				// blocks written back to the device
+} block_stats_t;
+
+extern block_stats_t block_stats;
+
+extern void block_cache_init(void);
+extern void block_cache_forget(block_dev_t* dev);
+extern uint8_t* bread(block_dev_t* dev, uint32_t block);
+extern void brelse(const void* data);
+extern void block_read_ahead(block_dev_t* dev, uint32_t block, uint32_t count);
+extern void bdirty(block_dev_t* dev, uint32_t block);
+extern void block_flush(void);
+
+#endif /* _BLOCK_CACHE_H */
@@ -0,0 +1,102 @@
+/* crc32c.c - CRC32C (Castagnoli) of a buffer, with the SSE4.2 crc32 instruction
+ *			  when the CPU has it, otherwise four tables that fold a word at a time
+ */
+#include "crc32c.h"
+
+static uint32_t crc_table[CRC32C_TABLES][256];
+static uint32_t crc_ready;
+uint32_t crc32c_hw;					// 1 when crc32c uses the crc32 instruction
+
+/* int32_t has_sse42()
+ * Task: check for the crc32 instruction, cpuid itself is only there when EFLAGS.ID can be changed
+ * Input : None
+ * Output: 1 if the CPU has SSE4.2, otherwise 0
+ */
+static int32_t has_sse42(void){
+	uint32_t before, after, ecx;
+	
+	asm volatile ("pushfl				\n\
+			pushfl						\n\
+			popl %0						\n\
+			movl %0, %1					\n\
+			xorl %2, %1					\n\
+			pushl %1					\n\
+			popfl						\n\
+			pushfl						\n\
+			popl %1						\n\
+			popfl						\n\
+			"
+			: "=&r"(before), "=&r"(after)
+			: "i"(EFLAGS_ID)
+			: "cc"
+	);
+	if (((before ^ after) & EFLAGS_ID) == 0){
+		return 0;
+	}
+	asm volatile ("cpuid"
+			: "=c"(ecx)
+			: "a"(1), "c"(0)
+			: "ebx", "edx"
+	);
+	return (ecx & CPUID_ECX_SSE42) != 0;
+}
+
+/* void crc32c_init()
+ * Task: choose the hardware or the software path, and fill the tables of the software one
+ *		 crc_table[k][i] is the CRC of byte i followed by k zero bytes
+ * Input : None
+ * Output: None
+ */
+static void crc32c_init(void){
+	uint32_t i, k, crc;
+	
+	for (i=0;i<256;i++){
+		crc = i;
+		for (k=0;k<8;k++){
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		}
+		crc_table[0][i] = crc;
+	}
+	for (k=1;k<CRC32C_TABLES;k++){
+		for (i=0;i<256;i++){
+			crc_table[k][i] = (crc_table[k-1][i] >> 8) ^ crc_table[0][crc_table[k-1][i] & 0xFF];
+		}
+	}
+	crc32c_hw = has_sse42();
+	crc_ready = 1;
+}
+
+/* uint32_t crc32c()
+ * Task: CRC32C of a buffer, the same value createfs stores for every block
+ * Input : buf------the data
+ *		   length---the number of bytes
+ * Output: the CRC
+ */
+uint32_t crc32c(const uint8_t* buf, uint32_t length){
+	uint32_t crc = 0xFFFFFFFF;
+	
+	if (!crc_ready){
+		crc32c_init();
+	}
+	
+	/* crc32 is a general purpose instruction, it needs no FPU or SSE state */
+	if (crc32c_hw){
+		for (;length>=4;length-=4,buf+=4){
+			asm ("crc32l %1, %0" : "+r"(crc) : "rm"(*(const uint32_t*)buf));
+		}
+		for (;length>0;length--,buf++){
+			asm ("crc32b %1, %0" : "+r"(crc) : "rm"(*buf));
+		}
+		return ~crc;
+	}
+	
+	for (;length>=4;length-=4,buf+=4){
+		crc ^= *(const uint32_t*)buf;
+		crc = crc_table[3][crc & 0xFF] ^ crc_table[2][(crc >> 8) & 0xFF]
+			^ crc_table[1][(crc >> 16) & 0xFF] ^ crc_table[0][crc >> 24];
+	}
+	for (;length>0;length--,buf++){
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *buf) & 0xFF];
+	}
+	return ~crc;
+}
@@ -0,0 +1,18 @@
+/* crc32c.h - Defines for crc32c.c
+ *			  used to check the blocks of file system images
+ */
+
+#ifndef _CRC32C_H
+#define _CRC32C_H
+
+#include "types.h"
+
+#define CRC32C_POLY 0x82F63B78		// Castagnoli polynomial, bit reversed
+#define CRC32C_TABLES 4				// the software path folds one 32-bit word per step
+#define EFLAGS_ID 0x00200000		// writable only on CPUs that have cpuid
+#define CPUID_ECX_SSE42 0x00100000	// leaf 1: the crc32 instruction exists
+
+extern uint32_t crc32c(const uint8_t* buf, uint32_t length);
+extern uint32_t crc32c_hw;
+
+#endif /* _CRC32C_H */
@@ -1,4 +1,5 @@
 #include "exception_handler.h"
+#include "syscall_handler.h"
 
 /*
  * squash
@@ -225,13 +226,17 @@ void exception_13() {
 
 /*
  * exception_14
- *	DESCRIPTION: handle exception 14
- *	INPUTs: none
+ *	DESCRIPTION: handle exception 14, pages of the user program are loaded on first touch
+ *	INPUTs: fault_addr - the address that caused the fault (cr2)
+ *			error_code - the error code pushed by the processor
  *	OUTPUTS: none
  *	RETURN VALUES: none
- *	SIDE EFFECT: print the exception message and squash user-level programs
+ *	SIDE EFFECT: load the missing user page, otherwise print the exception message
+ *				 and squash user-level programs
  */
-void exception_14() {
+void exception_14(uint32_t fault_addr, uint32_t error_code) {
+	if (load_user_page(fault_addr, error_code) == 0)
+		return;
 	printf("Page Fault Exception\n");
 	print_err_addr();
 	squash();
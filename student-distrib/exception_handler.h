@@ -22,7 +22,7 @@ extern void exception_10();
 extern void exception_11();
 extern void exception_12();
 extern void exception_13();
-extern void exception_14();
+extern void exception_14(uint32_t fault_addr, uint32_t error_code);
 extern void exception_16();
 extern void exception_17();
 extern void exception_18();
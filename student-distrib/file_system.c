@@ -3,52 +3,393 @@
 #include "file_system.h"
 #include "lib.h"
 #include "syscall_handler.h"
+#include "block_cache.h"
+#include "program_cache.h"
+#include "lz4.h"
+#include "mount.h"
+#include "crc32c.h"
 
 
+/* every mounted image, fs_table[FS_ROOT] is the root image */
+static fs_t fs_table[MAX_FS];
+fs_t* root_fs = &fs_table[FS_ROOT];
+
+/* decompressed blocks of compressed files */
+static lz4_block_t lz4_cache[LZ4_CACHE_SIZE];
+static uint32_t lz4_clock;
+/* the block of a read that can't wait for lz4_cache, a page fault runs with interrupts off */
+static lz4_block_t lz4_fault_block;
+
+/* fs_t* id_fs()
+ * Task:  find the image a file id is on
+ * Input : id----the file id
+ * Output: the image, NULL if nothing is mounted there
+ */
+static fs_t* id_fs(uint32_t id){
+	if (ID_FS(id) >= MAX_FS || !fs_table[ID_FS(id)].used){
+		return NULL;
+	}
+	return &fs_table[ID_FS(id)];
+}
+
+/* int32_t fs_feature()
+ * Task:  check whether an image has a feature, features are only valid on an image with FS_MAGIC
+ * Input : fs------the image
+ *		   flag----one of FS_FEATURE_*
+ * Output: 1 if the image has it, otherwise 0
+ */
+static int32_t fs_feature(fs_t* fs, uint32_t flag){
+	return fs->boot_block.magic == FS_MAGIC && (fs->boot_block.features & flag) != 0;
+}
+
+/* int32_t block_bad()
+ * Task:  check whether an image block failed its checksum at mount
+ * Input : fs-------the image
+ *		   block----the block number in the image
+ * Output: 1 if the block is bad, otherwise 0
+ */
+static int32_t block_bad(fs_t* fs, uint32_t block){
+	if (fs->check.bad_blocks == 0 || block >= MAX_CHECKED_BLOCKS){
+		return 0;
+	}
+	return (fs->bad_blocks[block/32] >> (block%32)) & 1;
+}
+
+/* uint8_t* data_block_addr()
+ * Task:  find a data block in the image, through the block cache, it stays pinned until brelse
+ * Input : fs-------the image
+ *		   block----the data block number
+ * Output: the address of the data block, NULL if it doesn't exist
+ */
+static uint8_t* data_block_addr(fs_t* fs, uint32_t block){
+	if (block>=fs->boot_block.num_data_blocks || block_bad(fs, fs->boot_block.num_inodes + 1 + block)){
+		return NULL;
+	}
+	return bread(fs->dev, fs->boot_block.num_inodes + 1 + block);
+}
+
+/* uint32_t good_run()
+ * Task:  cut a run of data blocks at its first bad block
+ * Input : fs-------the image
+ *		   block----the first data block of the run
+ *		   run------the number of blocks in the run
+ * Output: the number of blocks before the first bad one
+ */
+static uint32_t good_run(fs_t* fs, uint32_t block, uint32_t run){
+	uint32_t i;
+	
+	if (fs->check.bad_blocks == 0){
+		return run;
+	}
+	for (i=0;i<run;i++){
+		if (block_bad(fs, fs->boot_block.num_inodes + 1 + block + i)){
+			break;
+		}
+	}
+	return i;
+}
+
+/* void data_block_dirty()
+ * Task:  mark a data block changed, see bdirty
+ * Input : fs-------the image
+ *		   block----the data block number
+ * Output: None
+ */
+static void data_block_dirty(fs_t* fs, uint32_t block){
+	bdirty(fs->dev, fs->boot_block.num_inodes + 1 + block);
+}
+
+/* index_node_t* inode_block_addr()
+ * Task:  find an index node in the image, through the block cache, it stays pinned until brelse
+ * Input : fs-------the image
+ *		   inode----the inode number
+ * Output: the address of the index node, NULL if it doesn't exist
+ */
+static index_node_t* inode_block_addr(fs_t* fs, uint32_t inode){
+	if (inode>=fs->boot_block.num_inodes || block_bad(fs, inode + 1)){
+		return NULL;
+	}
+	return (index_node_t*)bread(fs->dev, inode + 1);
+}
+
+/* void build_dentry_table()
+ * Task:  collect the dentries of the boot block and of every chained directory block
+ * Input : fs----the image
+ * Output: None
+ */
+static void build_dentry_table(fs_t* fs){
+	uint32_t i, hops, next;
+	dir_block_t* dir_block;
+	
+	fs->num_dentries = 0;
+	for (i=0;i<fs->boot_block.num_dir_entries && i<MAX_DIR_ENTRIES;i++){
+		fs->dentry_table[fs->num_dentries++] = fs->boot_block.dir_entries[i];
+	}
+	
+	if (!fs_feature(fs, FS_FEATURE_DIR_CHAIN)){
+		return;
+	}
+	/* follow the chain, stop at a missing block, once the table is full, or after MAX_DIR_BLOCKS
+	 * blocks, a chain that long loops back (its blocks may be empty, so the table never fills) */
+	dir_block = (dir_block_t*)data_block_addr(fs, fs->boot_block.dir_next);
+	for (hops=0;fs->boot_block.dir_next != 0 && dir_block != NULL && hops<MAX_DIR_BLOCKS;hops++){
+		for (i=0;i<dir_block->num_dir_entries && i<MAX_DIR_ENTRIES;i++){
+			if (fs->num_dentries==MAX_DENTRIES){
+				brelse(dir_block);
+				return;
+			}
+			fs->dentry_table[fs->num_dentries++] = dir_block->dir_entries[i];
+		}
+		next = dir_block->dir_next;
+		brelse(dir_block);
+		if (next == 0){
+			break;
+		}
+		dir_block = (dir_block_t*)data_block_addr(fs, next);
+	}
+}
+
+/* uint32_t name_length()
+ * Task:  get the length of a dentry name, which is not null terminated when it has 32 chars
+ * Input : name----the name stored in a dentry
+ * Output: the length of the name, at most 32
+ */
+static uint32_t name_length(const int8_t* name){
+	uint32_t length = 0;
+	while (length<MAX_NAME_LENGTH && name[length]!='\0'){
+		length++;
+	}
+	return length;
+}
+
+/* uint32_t name_hash()
+ * Task:  hash a file name (FNV-1a) for the dentry index
+ * Input : name----the file name
+ *		   length--the length of the name
+ * Output: the hash value
+ */
+static uint32_t name_hash(const int8_t* name, uint32_t length){
+	uint32_t hash = FNV_OFFSET_BASIS;
+	uint32_t i;
+	for (i=0;i<length;i++){
+		hash ^= (uint8_t)name[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/* void index_dentry()
+ * Task:  hash one dentry of dentry_table into dentry_index
+ * Input : fs---the image
+ *		   i----the index in dentry_table
+ * Output: None
+ */
+static void index_dentry(fs_t* fs, uint32_t i){
+	uint32_t slot, length, hash;
+	
+	length = name_length(fs->dentry_table[i].file_name);
+	hash = name_hash(fs->dentry_table[i].file_name,length);
+	/* linear probing, the table is at least twice as large as the directory */
+	slot = hash & (DENTRY_INDEX_SIZE-1);
+	while (fs->dentry_index[slot].index != DENTRY_INDEX_EMPTY){
+		slot = (slot+1) & (DENTRY_INDEX_SIZE-1);
+	}
+	fs->dentry_index[slot].index = i;
+	fs->dentry_index[slot].length = length;
+	fs->dentry_index[slot].hash = hash;
+}
+
+/* void build_dentry_index()
+ * Task:  hash every dentry in dentry_table into dentry_index,
+ *		  keeping the precomputed length so lookups need only one string compare
+ * Input : fs----the image
+ * Output: None
+ */
+static void build_dentry_index(fs_t* fs){
+	uint32_t i;
+	
+	for (i=0;i<DENTRY_INDEX_SIZE;i++){
+		fs->dentry_index[i].index = DENTRY_INDEX_EMPTY;
+	}
+	
+	for (i=0;i<fs->num_dentries;i++){
+		index_dentry(fs, i);
+	}
+}
+
+/* dentry_t* root_lookup()
+ * Task:  find a name in the root directory of an image through its dentry index
+ * Input : fs-------the image
+ *		   name-----the name, not null terminated
+ *		   length---the length of the name, 0<length<=32
+ * Output: the entry in dentry_table, NULL if not found
+ */
+static dentry_t* root_lookup(fs_t* fs, const int8_t* name, uint32_t length){
+	uint32_t hash, slot;
+	dentry_t* entry;
+	
+	/* probe the index until an empty slot, only compare names whose hash and length match */
+	hash = name_hash(name,length);
+	slot = hash & (DENTRY_INDEX_SIZE-1);
+	while (fs->dentry_index[slot].index != DENTRY_INDEX_EMPTY){
+		if (fs->dentry_index[slot].hash == hash && fs->dentry_index[slot].length == length){
+			entry = &fs->dentry_table[fs->dentry_index[slot].index];
+			if (strncmp(name,entry->file_name,length)==0){
+				return entry;
+			}
+		}
+		slot = (slot+1) & (DENTRY_INDEX_SIZE-1);
+	}
+	return NULL;
+}
+
+/* int32_t subdir_header()
+ * Task:  read and check the header of a subdirectory
+ * Input : dir------the file id of the subdirectory
+ *		   header---filled with the header
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t subdir_header(uint32_t dir, subdir_header_t* header){
+	if (read_data(dir, 0, (uint8_t*)header, sizeof(subdir_header_t)) != sizeof(subdir_header_t)){
+		return -1;
+	}
+	if (header->magic != SUBDIR_MAGIC || (header->hash_size & (header->hash_size-1)) != 0){
+		return -1;
+	}
+	return 0;
+}
+
+/* int32_t subdir_entry()
+ * Task:  read one dentry of a subdirectory, its inode stays the inode number on the image
+ * Input : dir------the file id of the subdirectory
+ *		   index----the index of the dentry, below num_entries of the header
+ *		   dentry---filled with the dentry
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t subdir_entry(uint32_t dir, uint32_t index, dentry_t* dentry){
+	uint32_t offset = sizeof(subdir_header_t) + index*sizeof(dentry_t);
+	
+	return (read_data(dir, offset, (uint8_t*)dentry, sizeof(dentry_t)) == sizeof(dentry_t)) ? 0 : -1;
+}
+
+/* int32_t subdir_lookup()
+ * Task:  find a name in a subdirectory, through its hash index when it has one,
+ *		  so a lookup reads one slot and one dentry per probe however large the directory is
+ * Input : dir------the file id of the subdirectory
+ *		   name-----the name, not null terminated
+ *		   length---the length of the name, 0<length<=32
+ *		   dentry---filled with the dentry, its inode stays the inode number on the image
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t subdir_lookup(uint32_t dir, const int8_t* name, uint32_t length, dentry_t* dentry){
+	subdir_header_t header;
+	uint32_t table, slot, index, probes;
+	
+	if (subdir_header(dir, &header) != 0){
+		return -1;
+	}
+	
+	/* small directories have no index, they are scanned */
+	if (header.hash_size == 0){
+		for (index=0;index<header.num_entries;index++){
+			if (subdir_entry(dir, index, dentry) != 0){
+				return -1;
+			}
+			if (name_length(dentry->file_name) == length && strncmp(name,dentry->file_name,length)==0){
+				return 0;
+			}
+		}
+		return -1;
+	}
+	
+	/* probe the slots until an empty one, the table follows the dentries */
+	table = sizeof(subdir_header_t) + header.num_entries*sizeof(dentry_t);
+	slot = name_hash(name,length) & (header.hash_size-1);
+	for (probes=0;probes<header.hash_size;probes++){
+		if (read_data(dir, table + slot*sizeof(uint32_t), (uint8_t*)&index, sizeof(index)) != sizeof(index)){
+			return -1;
+		}
+		if (index == 0 || index > header.num_entries || subdir_entry(dir, index-1, dentry) != 0){
+			return -1;
+		}
+		if (name_length(dentry->file_name) == length && strncmp(name,dentry->file_name,length)==0){
+			return 0;
+		}
+		slot = (slot+1) & (header.hash_size-1);
+	}
+	return -1;
+}
+
 /* int32_t read_dentry_by_name()
  * Task:  fill in the dentry t block passed as their second argument with the file name,
  *																			 file type,
  *																			 inode number for the file
+ *		  the name is looked up on the image mounted at its longest matching prefix,
+ *		  then one directory at a time along the path ("dir/sub/file"),
+ *		  the inode number in dentry is a file id, see FILE_ID
  * Input : fname----a pointer of the file name need to be read
  *		   dentry---a pointer of the new dentry need to be filled
  * Output: success return 0, otherwise return -1
  */
 int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry){
-	int length = strlen((int8_t*)fname);	/* in lib.c */
-	int i,true_length;
-	/* check the length which need to be in 0<length<=32 */
-	if (length>MAX_NAME_LENGTH || length==0){
-		return -1;
-	}
+	uint32_t length, dir = 0;
+	int32_t id;
+	fs_t* fs;
+	dentry_t* entry;
+	dentry_t found;
 	
-	if (length==MAX_NAME_LENGTH){
-		true_length = length+1;
-	}
-	else{
-		true_length = length;
+	/* a name under a prefix that isn't an image (the tmpfs) is never found here */
+	id = mount_lookup(fname, MOUNT_IMAGE, &fname);
+	if (id < 0 || (fs = id_fs(FILE_ID(id, 0))) == NULL){
+		return -1;
 	}
 	
-	/* check the dentry with the same name */
-	for (i=0;i<bootBlock->num_dir_entries;i++){
-		/* if find the same name----in lib.c */
-		/* check the length of the file first */
-		if (true_length == strlen(bootBlock->dir_entries[i].file_name)){
-			if(strncmp((int8_t*)fname,bootBlock->dir_entries[i].file_name,length)==0){
-				strcpy(dentry->file_name,bootBlock->dir_entries[i].file_name);		/* pass the file name */
-				dentry->file_type = bootBlock->dir_entries[i].file_type;			/* pass the file type */
-				dentry->inode = bootBlock->dir_entries[i].inode;					/* pass the number of inode */
-				inode_number = bootBlock->dir_entries[i].inode;
-				
-				index_node_t* inode_block;
-				inode_block = (index_node_t*)bootBlock+inode_number+1;		// find the corresponding inode block
-	
-				f_size = inode_block->length;
-				return 0;	/* success */
+	/* inode 0 is the root directory, whose names are in the in-memory index */
+	while (1){
+		length = 0;
+		while (fname[length] != '\0' && fname[length] != PATH_SEPARATOR){
+			length++;
+		}
+		
+		/* check the length which need to be in 0<length<=32 */
+		if (length>MAX_NAME_LENGTH || length==0){
+			return -1;
+		}
+		if (dir == 0){
+			if ((entry = root_lookup(fs, (int8_t*)fname, length)) == NULL){
+				return -1;
 			}
+			found = *entry;
+		}
+		else if (subdir_lookup(FILE_ID(id, dir), (int8_t*)fname, length, &found) != 0){
+			return -1;
+		}
+		if (fname[length] == '\0'){
+			break;
+		}
+		
+		/* only a directory goes on, "." of a legacy image has inode 0 and stays in the root */
+		if (found.file_type != 1 || (found.inode != 0 && !fs_feature(fs, FS_FEATURE_SUBDIRS))){
+			return -1;
+		}
+		dir = found.inode;
+		fname += length;
+		while (*fname == PATH_SEPARATOR){
+			fname++;
+		}
+		/* a trailing separator names the directory itself */
+		if (*fname == '\0'){
+			break;
 		}
 	}
-	/* don't find, fail */
-	return -1;
+	
+	strncpy(dentry->file_name,found.file_name,MAX_NAME_LENGTH);	/* pass the file name */
+	dentry->file_type = found.file_type;			/* pass the file type */
+	dentry->inode = FILE_ID(id, found.inode);		/* pass the number of inode */
+	inode_number = dentry->inode;
+	
+	f_size = file_length(inode_number);
+	return 0;	/* success */
 }
 
 
@@ -56,83 +397,1167 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry){
  * Task:  fill in the dentry t block passed as their second argument with the file name,
  *																			 file type,
  *																			 inode number for the file
+ *		  from the directory of the root image
  * Input : index----a pointer of the index of inode need to be read
  *		   dentry---a pointer of the new dentry need to be filled
  * Output: success return 0, otherwise return -1
  */
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
-	/* check the index which need to be in 0=<index<63===>0--(N-1) */
-	if (index>=bootBlock->num_dir_entries || index<0){
+	return read_dentry_in_dir(FILE_ID(FS_ROOT, 0), index, dentry);
+}
+
+/* int32_t read_dentry_in_dir()
+ * Task:  same as read_dentry_by_index, from the root directory or a subdirectory of any mounted image
+ * Input : dir------the file id of the directory, as filled in by read_dentry_by_name
+ *		   index----the index of the dentry
+ *		   dentry---a pointer of the new dentry need to be filled
+ * Output: success return 0, otherwise return -1
+ */
+int32_t read_dentry_in_dir (uint32_t dir, uint32_t index, dentry_t* dentry){
+	fs_t* fs = id_fs(dir);
+	subdir_header_t header;
+	dentry_t entry;
+	
+	if (fs != NULL && ID_INODE(dir) != 0){
+		if (subdir_header(dir, &header) != 0 || index >= header.num_entries || subdir_entry(dir, index, &entry) != 0){
+			return -1;
+		}
+		strncpy(dentry->file_name,entry.file_name,MAX_NAME_LENGTH);
+		dentry->file_type = entry.file_type;
+		dentry->inode = FILE_ID(ID_FS(dir), entry.inode);
+		return 0;
+	}
+	
+	/* check the index which need to be in 0=<index<N===>0--(N-1) */
+	if (fs == NULL || index>=fs->num_dentries){
 		return -1;
 	}
 	
 	/* store the dentry by index */
-	strcpy(dentry->file_name,bootBlock->dir_entries[index].file_name);		/* pass the file name */
-	dentry->file_type = bootBlock->dir_entries[index].file_type;			/* pass the file type */
-	dentry->inode = bootBlock->dir_entries[index].inode;					/* pass the number of inode */
+	strncpy(dentry->file_name,fs->dentry_table[index].file_name,MAX_NAME_LENGTH);		/* pass the file name */
+	dentry->file_type = fs->dentry_table[index].file_type;			/* pass the file type */
+	dentry->inode = FILE_ID(ID_FS(dir), fs->dentry_table[index].inode);	/* pass the number of inode */
 	
 	return 0;
 }
 
-/* int32_t read_data()
- * Task: copy the file data into buf
- * Input : inode----the inode number need to read (index node)
+/* int32_t indirect_lookup()
+ * Task: find the data block of a file block in an index node with indirect blocks
+ * Input : fs----------------the image
+ *		   indirect_block----the index node of the file
+ *		   file_block--------the index of the block inside the file
+ *		   block-------------filled with the data block number
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t indirect_lookup(fs_t* fs, indirect_node_t* indirect_block, uint32_t file_block, uint32_t* block){
+	uint32_t* pointers;
+	uint32_t next;
+	
+	if (file_block < MAX_DIRECT_BLOCKS){
+		*block = indirect_block->data_block[file_block];
+		return 0;
+	}
+	file_block -= MAX_DIRECT_BLOCKS;
+	
+	if (file_block < BLOCK_POINTERS){
+		pointers = (uint32_t*)data_block_addr(fs, indirect_block->single_indirect);
+	}
+	else{
+		file_block -= BLOCK_POINTERS;
+		if (file_block >= BLOCK_POINTERS*BLOCK_POINTERS){
+			return -1;				/* past the largest file */
+		}
+		pointers = (uint32_t*)data_block_addr(fs, indirect_block->double_indirect);
+		if (pointers == NULL){
+			return -1;
+		}
+		next = pointers[file_block/BLOCK_POINTERS];
+		brelse(pointers);
+		pointers = (uint32_t*)data_block_addr(fs, next);
+		file_block %= BLOCK_POINTERS;
+	}
+	if (pointers == NULL){
+		return -1;
+	}
+	*block = pointers[file_block];
+	brelse(pointers);
+	return 0;
+}
+
+/* int32_t map_block()
+ * Task: find where a block of a file lives in the image
+ * Input : fs-------------the image
+ *		   inode_block----the index node of the file
+ *		   file_block-----the index of the block inside the file
+ *		   max_run--------the number of blocks the caller still needs
+ *		   run------------filled with the number of blocks, at most max_run, that are
+ *						  contiguous in the image starting from the returned block
+ * Output: success return the data block number, otherwise return -1
+ */
+static int32_t map_block(fs_t* fs, index_node_t* inode_block, uint32_t file_block, uint32_t max_run, uint32_t* run){
+	uint32_t block, i;
+	
+	if (fs_feature(fs, FS_FEATURE_EXTENTS) && ((extent_node_t*)inode_block)->magic == EXTENT_MAGIC){
+		/* extent-based index node: walk the extents until the one holding file_block */
+		extent_node_t* extent_block = (extent_node_t*)inode_block;
+		for (i=0;i<extent_block->num_extents && i<MAX_EXTENTS;i++){
+			if (file_block < extent_block->extents[i].count){
+				block = extent_block->extents[i].start + file_block;
+				*run = extent_block->extents[i].count - file_block;
+				break;
+			}
+			file_block -= extent_block->extents[i].count;
+		}
+		if (i==extent_block->num_extents || i==MAX_EXTENTS){
+			return -1;					/* past the last extent */
+		}
+	}
+	else if (fs_feature(fs, FS_FEATURE_INDIRECT) && ((indirect_node_t*)inode_block)->magic == INDIRECT_MAGIC){
+		/* index node with indirect blocks: every lookup is O(1), count the adjacent ones */
+		indirect_node_t* indirect_block = (indirect_node_t*)inode_block;
+		uint32_t next;
+		if (indirect_lookup(fs, indirect_block, file_block, &block) != 0){
+			return -1;
+		}
+		*run = 1;
+		while (*run<max_run && indirect_lookup(fs, indirect_block, file_block+*run, &next)==0 && next==block+*run){
+			(*run)++;
+		}
+	}
+	else{
+		/* legacy index node: count how many of the following data blocks are adjacent */
+		block = inode_block->data_block[file_block];
+		*run = 1;
+		while (*run<max_run && inode_block->data_block[file_block+*run]==block+*run){
+			(*run)++;
+		}
+	}
+	
+	if (*run>max_run){
+		*run = max_run;
+	}
+	/* the whole run must exist */
+	if (block>=fs->boot_block.num_data_blocks || *run>fs->boot_block.num_data_blocks-block){
+		return -1;
+	}
+	return block;
+}
+
+/* int32_t is_compressed()
+ * Task: check whether an index node holds an LZ4 stream
+ * Input : fs-------------the image
+ *		   inode_block----the index node of the file
+ * Output: 1 if the file is compressed, otherwise 0
+ */
+static int32_t is_compressed(fs_t* fs, index_node_t* inode_block){
+	extent_node_t* extent_block = (extent_node_t*)inode_block;
+	
+	return extent_block != NULL && fs_feature(fs, FS_FEATURE_LZ4) && extent_block->magic == EXTENT_MAGIC && (extent_block->flags & EXTENT_FLAG_LZ4);
+}
+
+/* int32_t read_stream()
+ * Task: copy the bytes stored in the data blocks of a file into buf, the caller checks the length
+ *		 the copy is done span by span: a span is a run of bytes that is contiguous in the image
+ *		 (one extent, or adjacent data blocks of a legacy index node),
+ *		 and every span is moved with one memcpy (rep movsl), so bounds are only checked at span edges
+ * Input : fs-------the image
+ *		   inode----the inode number
  *		   offset---the position from which to start reading
  *		   buf------a pointer to a buf which we copy data into
  *		   length---the number of bytes to read
  * Output: success return the number of bytes, otherwise return -1
  */
-int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-	/* check the index first */
-	 if (inode>=bootBlock->num_inodes || inode<0){
-		 return -1;
-	 }
-	 
+static int32_t read_stream (fs_t* fs, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
 	 index_node_t* inode_block;
-	 inode_block = (index_node_t*)bootBlock+inode+1;		/* find the corresponding inode block  */
-	 
-	 /* find the location of the start data block */
 	 uint32_t data_block_index = offset/FOUR_KB;				/* find the corresponding data block */
 	 uint32_t data_line_index = offset%FOUR_KB;				/* find the corresponding data in data block */
-	 uint8_t* data_ptr = (uint8_t*)(bootBlock + bootBlock->num_inodes + 1 + inode_block->data_block[data_block_index])+data_line_index;
-	 int i;
+	 uint32_t copied = 0;
+	 uint32_t run, span, max_run;
+	 int32_t block;
+	 uint8_t* block_addr;
 	 
-	 for (i=0;i<length;i++){
-		  if (i+offset >= inode_block->length){
-			  return i;						/* data in current inode has already been copied */
+	 while (copied<length){
+		  /* the index node is only pinned while the span is mapped */
+		  inode_block = inode_block_addr(fs, inode);
+		  if (inode_block == NULL){
+			  return -1;
+		  }
+		  /* blocks still needed from here to the end of the request, a cached device hands out one block at a time */
+		  max_run = (data_line_index+length-copied+FOUR_KB-1)/FOUR_KB;
+		  if (fs->dev->base == NULL){
+			  max_run = 1;
+		  }
+		  block = map_block(fs, inode_block, data_block_index, max_run, &run);
+		  brelse(inode_block);
+		  if (block<0){
+			  return -1;				/* the data block doesn't exist */
+		  }
+		  /* a span stops before a bad block, the read fails when it gets there */
+		  run = good_run(fs, block, run);
+		  if (run == 0){
+			  return -1;
 		  }
 		  
-		  buf[i] = *data_ptr;				/* store byte in buf */
-		  data_line_index++;				/* move to next data in the current data block */
-
-		  if (data_line_index%FOUR_KB==0){		/* the current data block has already finished, move to next data block */
-			  data_block_index++;
-			  if (inode_block->data_block[data_block_index]>=bootBlock->num_data_blocks){
-				  return -1;				/* the next data block doesn't exist */
-			  }
-			  /* reset data pointer to the first of the next data block */
-			  data_ptr = (uint8_t*)(bootBlock + bootBlock->num_inodes + 1 + inode_block->data_block[data_block_index]);
-			  /* now, the data index is 0 */
+		  span = run*FOUR_KB - data_line_index;
+		  if (span > length-copied){
+			  span = length-copied;
 		  }
-		  else{
-			  data_ptr++;	/* move to next data */
+		  
+		  block_addr = data_block_addr(fs, block);
+		  if (block_addr == NULL){
+			  return -1;
 		  }
-			  
+		  memcpy(buf+copied, block_addr+data_line_index, span);
+		  brelse(block_addr);
+		  copied += span;
+		  data_block_index += run;
+		  data_line_index = 0;		/* the next span starts at the beginning of a data block */
 	 }
 		 
-	 return length;
+	 return copied;
+ }
+
+/* lz4_block_t* lz4_block_get()
+ * Task: get one decompressed block of a compressed file, from lz4_cache or decompressed into it,
+ *		 the entry stays busy until lz4_block_put so nobody reuses it while the caller copies from it,
+ *		 interrupts are only off while the entry is picked, the device may run other processes meanwhile,
+ *		 a caller with interrupts off never waits, it decompresses into lz4_fault_block
+ * Input : fs-----------the image
+ *		   id-----------the file id of the file
+ *		   length-------the length of the file
+ *		   file_block---the index of the block inside the file
+ * Output: the entry holding the data, NULL if the stream is corrupt
+ */
+static lz4_block_t* lz4_block_get(fs_t* fs, uint32_t id, uint32_t length, uint32_t file_block){
+	lz4_block_t* entry;
+	uint32_t inode = ID_INODE(id);
+	uint32_t offset[2], stored, size, i, flags;
+	
+	/* wait while another process decompresses or copies the block, or every entry is busy */
+	while (1){
+		cli_and_save(flags);
+		entry = NULL;
+		for (i=0;i<LZ4_CACHE_SIZE && entry==NULL;i++){
+			if ((lz4_cache[i].valid || lz4_cache[i].busy) && lz4_cache[i].inode == id && lz4_cache[i].file_block == file_block){
+				entry = &lz4_cache[i];
+			}
+		}
+		if (entry != NULL && !entry->busy){
+			entry->busy = 1;
+			entry->last_use = ++lz4_clock;
+			restore_flags(flags);
+			return entry;
+		}
+		if (entry == NULL){
+			for (i=0;i<LZ4_CACHE_SIZE;i++){
+				if (!lz4_cache[i].busy && (entry == NULL || !lz4_cache[i].valid || lz4_cache[i].last_use < entry->last_use)){
+					entry = &lz4_cache[i];
+				}
+			}
+			if (entry != NULL){
+				break;
+			}
+		}
+		/* the process holding the entry can't run until interrupts are back on */
+		if (!(flags & IF_FLAG)){
+			entry = &lz4_fault_block;
+			break;
+		}
+		restore_flags(flags);
+	}
+	entry->busy = 1;
+	entry->valid = 0;
+	entry->inode = id;
+	entry->file_block = file_block;
+	entry->last_use = ++lz4_clock;
+	restore_flags(flags);
+	
+	/* where the block sits in the stream */
+	size = length - file_block*FOUR_KB;
+	if (size > FOUR_KB){
+		size = FOUR_KB;
+	}
+	if (read_stream(fs, inode, file_block*sizeof(uint32_t), (uint8_t*)offset, sizeof(offset)) != sizeof(offset) || offset[1] < offset[0]){
+		entry->busy = 0;
+		return NULL;
+	}
+	stored = offset[1] - offset[0];
+	if (stored > size){
+		entry->busy = 0;
+		return NULL;
+	}
+	
+	if (stored == size){
+		/* it didn't compress, kept as is */
+		if (read_stream(fs, inode, offset[0], entry->data, size) != size){
+			entry->busy = 0;
+			return NULL;
+		}
+	}
+	else if (read_stream(fs, inode, offset[0], entry->input, stored) != stored || lz4_decompress(entry->input, stored, entry->data, size) != size){
+		entry->busy = 0;
+		return NULL;
+	}
+	entry->valid = 1;
+	return entry;
+}
+
+/* void lz4_block_put()
+ * Task: the caller is done with an entry from lz4_block_get
+ * Input : entry----the entry
+ * Output: None
+ */
+static void lz4_block_put(lz4_block_t* entry){
+	entry->busy = 0;
+}
+
+/* int32_t read_compressed()
+ * Task: copy the data of a compressed file into buf, one decompressed block at a time
+ * Input : fs-------the image
+ *		   id-------the file id, the caller checked offset and length against the file length
+ *		   file_length----the length of the file
+ *		   offset---the position from which to start reading
+ *		   buf------a pointer to a buf which we copy data into
+ *		   length---the number of bytes to read
+ * Output: success return the number of bytes, otherwise return -1
+ */
+static int32_t read_compressed (fs_t* fs, uint32_t id, uint32_t file_length, uint32_t offset, uint8_t* buf, uint32_t length){
+	uint32_t copied = 0, line, span;
+	lz4_block_t* entry;
+	
+	while (copied<length){
+		line = (offset+copied)%FOUR_KB;
+		span = FOUR_KB - line;
+		if (span > length-copied){
+			span = length-copied;
+		}
+		entry = lz4_block_get(fs, id, file_length, (offset+copied)/FOUR_KB);
+		if (entry == NULL){
+			return -1;
+		}
+		memcpy(buf+copied, entry->data+line, span);
+		lz4_block_put(entry);
+		copied += span;
+	}
+	return copied;
+}
+
+/* int32_t read_data()
+ * Task: copy the file data into buf, a compressed file is decompressed block by block
+ * Input : id-------the file id need to read (image and index node)
+ *		   offset---the position from which to start reading
+ *		   buf------a pointer to a buf which we copy data into
+ *		   length---the number of bytes to read
+ * Output: success return the number of bytes, otherwise return -1
+ */
+int32_t read_data (uint32_t id, uint32_t offset, uint8_t* buf, uint32_t length){
+	fs_t* fs = id_fs(id);
+	uint32_t inode = ID_INODE(id);
+	
+	/* check the index first */
+	 if (fs == NULL || inode>=fs->boot_block.num_inodes){
+		 return -1;
+	 }
+	 
+	 index_node_t* inode_block;
+	 uint32_t file_length, compressed;
+	 inode_block = inode_block_addr(fs, inode);		/* find the corresponding inode block  */
+	 if (inode_block == NULL){
+		 return -1;
+	 }
+	 file_length = inode_block->length;
+	 compressed = is_compressed(fs, inode_block);
+	 brelse(inode_block);
+	 
+	 /* data in current inode has already been copied */
+	 if (offset >= file_length){
+		 return 0;
+	 }
+	 /* never copy past the end of the file */
+	 if (length > file_length - offset){
+		 length = file_length - offset;
+	 }
+	 
+	 if (compressed){
+		 return read_compressed(fs, id, file_length, offset, buf, length);
+	 }
+	 return read_stream(fs, inode, offset, buf, length);
  }
  
+ /* uint32_t file_length()
+ * Task: get the length of a file
+ * Input : id----the file id of the file
+ * Output: the length in bytes, 0 if the inode doesn't exist
+ */
+uint32_t file_length (uint32_t id){
+	fs_t* fs = id_fs(id);
+	index_node_t* inode_block;
+	uint32_t length;
+	
+	if (fs == NULL || (inode_block = inode_block_addr(fs, ID_INODE(id))) == NULL){
+		return 0;
+	}
+	length = inode_block->length;
+	brelse(inode_block);
+	return length;
+}
+
+/* uint8_t* file_block_addr()
+ * Task: find where one block of a file sits in the memory-resident image,
+ *		 used to map file data without copying it, a cached device has no fixed address
+ *		 and a block of a writable image may be freed and given to another file while mapped
+ * Input : id-----------the file id of the file
+ *		   file_block---the index of the block inside the file
+ * Output: the address of the data block, NULL if the block doesn't exist or may move
+ */
+uint8_t* file_block_addr (uint32_t id, uint32_t file_block){
+	fs_t* fs = id_fs(id);
+	uint32_t inode = ID_INODE(id);
+	uint32_t run;
+	int32_t block;
+	
+	index_node_t* inode_block;
+	
+	/* nothing of a memory-resident image is pinned, its blocks never move */
+	if (fs == NULL || fs->dev->base == NULL || fs_feature(fs, FS_FEATURE_WRITABLE)){
+		return NULL;
+	}
+	if (file_block >= (file_length(id)+FOUR_KB-1)/FOUR_KB){
+		return NULL;
+	}
+	inode_block = inode_block_addr(fs, inode);
+	if (inode_block == NULL || is_compressed(fs, inode_block)){
+		return NULL;
+	}
+	block = map_block(fs, inode_block, file_block, 1, &run);
+	if (block<0){
+		return NULL;
+	}
+	return data_block_addr(fs, block);
+}
+
+/* int32_t fs_writable()
+ * Task: check whether the image has bitmaps to allocate from
+ * Input : fs----the image
+ * Output: 1 if files can be written, otherwise 0
+ */
+static int32_t fs_writable(fs_t* fs){
+	return fs_feature(fs, FS_FEATURE_WRITABLE) && fs_feature(fs, FS_FEATURE_EXTENTS);
+}
+
+/* void fs_lock()
+ * Task: wait until no other process changes the image, then hold it, two files may otherwise
+ *		 get the same free block, interrupts are only off while the flag is checked
+ * Input : fs----the image
+ * Output: None
+ */
+static void fs_lock(fs_t* fs){
+	uint32_t flags;
+	
+	while (1){
+		cli_and_save(flags);
+		if (!fs->writing){
+			fs->writing = 1;
+			restore_flags(flags);
+			return;
+		}
+		restore_flags(flags);
+	}
+}
+
+/* void fs_unlock()
+ * Task: let the next process change the image
+ * Input : fs----the image
+ * Output: None
+ */
+static void fs_unlock(fs_t* fs){
+	fs->writing = 0;
+}
+
+/* int32_t bitmap_get()
+ * Task: read one bit of a bitmap
+ * Input : fs-------the image
+ *		   first----the first data block of the bitmap
+ *		   n--------the bit
+ * Output: the bit, 1 if the bitmap can't be read
+ */
+static int32_t bitmap_get(fs_t* fs, uint32_t first, uint32_t n){
+	uint8_t* map = data_block_addr(fs, first + n/BITS_PER_BLOCK);
+	int32_t bit;
+	
+	if (map == NULL){
+		return 1;
+	}
+	n %= BITS_PER_BLOCK;
+	bit = (map[n/8] >> (n%8)) & 1;
+	brelse(map);
+	return bit;
+}
+
+/* void bitmap_set()
+ * Task: change one bit of a bitmap
+ * Input : fs-------the image
+ *		   first----the first data block of the bitmap
+ *		   n--------the bit
+ *		   value----the new bit
+ * Output: None
+ */
+static void bitmap_set(fs_t* fs, uint32_t first, uint32_t n, uint32_t value){
+	uint32_t block = first + n/BITS_PER_BLOCK;
+	uint8_t* map = data_block_addr(fs, block);
+	
+	if (map == NULL){
+		return;
+	}
+	n %= BITS_PER_BLOCK;
+	if (value){
+		map[n/8] |= 1 << (n%8);
+	}
+	else{
+		map[n/8] &= ~(1 << (n%8));
+	}
+	data_block_dirty(fs, block);
+	brelse(map);
+}
+
+/* void free_run()
+ * Task: give data blocks back to the block bitmap
+ * Input : fs-------the image
+ *		   start----the first data block
+ *		   count----the number of data blocks
+ * Output: None
+ */
+static void free_run(fs_t* fs, uint32_t start, uint32_t count){
+	uint32_t i;
+	
+	for (i=0;i<count;i++){
+		bitmap_set(fs, fs->boot_block.block_bitmap, start+i, 0);
+	}
+}
+
+/* int32_t alloc_run()
+ * Task: allocate contiguous data blocks, right after goal if it is free,
+ *		 otherwise the first free run that is long enough, otherwise the longest free run
+ *		 every allocated block is zeroed
+ * Input : fs------the image
+ *		   goal----the data block that would continue the file
+ *		   want----the number of blocks wanted
+ *		   got-----filled with the number of blocks allocated, between 1 and want
+ * Output: success return the first data block, -1 if the image is full
+ */
+static int32_t alloc_run(fs_t* fs, uint32_t goal, uint32_t want, uint32_t* got){
+	uint32_t total = fs->boot_block.num_data_blocks;
+	uint32_t n, bit, start = 0, run = 0, best_start = 0, best_run = 0;
+	uint8_t* map = NULL;
+	
+	/* continue the last run of the file */
+	while (goal+best_run < total && best_run < want && !bitmap_get(fs, fs->boot_block.block_bitmap, goal+best_run)){
+		best_run++;
+	}
+	best_start = goal;
+	
+	if (best_run == 0){
+		for (n=0;n<total && run<want;n++){
+			bit = n % BITS_PER_BLOCK;
+			if (bit == 0){
+				brelse(map);
+				map = data_block_addr(fs, fs->boot_block.block_bitmap + n/BITS_PER_BLOCK);
+				if (map == NULL){
+					break;
+				}
+			}
+			/* skip full bytes */
+			if (bit%8 == 0 && map[bit/8] == 0xFF && n+8 <= total){
+				run = 0;
+				n += 7;
+				continue;
+			}
+			if (map[bit/8] & (1 << (bit%8))){
+				run = 0;
+				continue;
+			}
+			if (run == 0){
+				start = n;
+			}
+			run++;
+			if (run > best_run){
+				best_run = run;
+				best_start = start;
+			}
+		}
+		brelse(map);
+	}
+	if (best_run == 0){
+		return -1;
+	}
+	
+	for (n=0;n<best_run;n++){
+		bitmap_set(fs, fs->boot_block.block_bitmap, best_start+n, 1);
+		map = data_block_addr(fs, best_start+n);
+		if (map != NULL){
+			memset(map, 0, FOUR_KB);
+			data_block_dirty(fs, best_start+n);
+			brelse(map);
+		}
+	}
+	*got = best_run;
+	return best_start;
+}
+
+/* extent_node_t* writable_node()
+ * Task: get the index node of a file that can be written, pinned until brelse
+ * Input : fs-------the image
+ *		   inode----the inode number
+ * Output: the extent index node, NULL if the file can't be written
+ */
+static extent_node_t* writable_node(fs_t* fs, uint32_t inode){
+	extent_node_t* node = (extent_node_t*)inode_block_addr(fs, inode);
+	
+	if (!fs_writable(fs) || node == NULL || node->magic != EXTENT_MAGIC || is_compressed(fs, (index_node_t*)node)){
+		brelse(node);
+		return NULL;
+	}
+	return node;
+}
+
+/* int32_t write_file()
+ * Task: write_data once the image is held by fs_lock
+ * Input : fs-------the image
+ *		   id-------the file id of the file
+ *		   offset---the position from which to start writing
+ *		   buf------the data
+ *		   length---the number of bytes to write
+ * Output: same as write_data
+ */
+static int32_t write_file (fs_t* fs, uint32_t id, uint32_t offset, const uint8_t* buf, uint32_t length){
+	uint32_t inode = ID_INODE(id);
+	extent_node_t* node = writable_node(fs, inode);
+	uint32_t need, have, i, got, goal, copied, span, run, file_block, line;
+	int32_t start, block;
+	uint8_t* addr;
+	
+	if (node == NULL || offset+length < offset){
+		brelse(node);
+		return -1;
+	}
+	if (length == 0){
+		brelse(node);
+		return 0;
+	}
+	
+	/* allocate the missing blocks, the index node stays pinned while the bitmaps are read */
+	need = (offset+length+FOUR_KB-1)/FOUR_KB;
+	have = 0;
+	for (i=0;i<node->num_extents;i++){
+		have += node->extents[i].count;
+	}
+	while (have < need){
+		goal = 0;
+		if (node->num_extents > 0){
+			goal = node->extents[node->num_extents-1].start + node->extents[node->num_extents-1].count;
+		}
+		start = alloc_run(fs, goal, need-have, &got);
+		if (start < 0){
+			break;
+		}
+		if (node->num_extents > 0 && (uint32_t)start == goal){
+			node->extents[node->num_extents-1].count += got;
+		}
+		else if (node->num_extents < MAX_EXTENTS){
+			node->extents[node->num_extents].start = start;
+			node->extents[node->num_extents].count = got;
+			node->num_extents++;
+		}
+		else{
+			free_run(fs, start, got);		/* no room for another extent */
+			break;
+		}
+		bdirty(fs->dev, inode + 1);
+		have += got;
+	}
+	if (have*FOUR_KB <= offset){
+		brelse(node);
+		return -1;
+	}
+	if (offset+length > have*FOUR_KB){
+		length = have*FOUR_KB - offset;
+	}
+	
+	/* copy block by block */
+	copied = 0;
+	file_block = offset/FOUR_KB;
+	line = offset%FOUR_KB;
+	while (copied<length){
+		block = map_block(fs, (index_node_t*)node, file_block, 1, &run);
+		if (block<0 || (addr = data_block_addr(fs, block)) == NULL){
+			break;
+		}
+		span = FOUR_KB - line;
+		if (span > length-copied){
+			span = length-copied;
+		}
+		memcpy(addr+line, buf+copied, span);
+		data_block_dirty(fs, block);
+		brelse(addr);
+		copied += span;
+		file_block++;
+		line = 0;
+	}
+	
+	if (offset+copied > node->length){
+		node->length = offset+copied;
+		bdirty(fs->dev, inode + 1);
+	}
+	brelse(node);
+	program_cache_drop(id);
+	return copied;
+}
+
+/* int32_t write_data()
+ * Task: copy buf into a file, blocks past the end of the file are allocated in runs as long as possible
+ * Input : id-------the file id of the file
+ *		   offset---the position from which to start writing
+ *		   buf------the data
+ *		   length---the number of bytes to write
+ * Output: success return the number of bytes written, less than length if the image is full,
+ *		   -1 if the file can't be written
+ */
+int32_t write_data (uint32_t id, uint32_t offset, const uint8_t* buf, uint32_t length){
+	fs_t* fs = id_fs(id);
+	int32_t ret;
+	
+	if (fs == NULL){
+		return -1;
+	}
+	fs_lock(fs);
+	ret = write_file(fs, id, offset, buf, length);
+	fs_unlock(fs);
+	return ret;
+}
+
+/* int32_t truncate_file()
+ * Task: truncate_data once the image is held by fs_lock
+ * Input : fs-------the image
+ *		   id-------the file id of the file
+ *		   length---the new length, at most the current one
+ * Output: same as truncate_data
+ */
+static int32_t truncate_file (fs_t* fs, uint32_t id, uint32_t length){
+	uint32_t inode = ID_INODE(id);
+	extent_node_t* node = writable_node(fs, inode);
+	uint32_t keep, total, i, kept, run;
+	int32_t block;
+	uint8_t* addr;
+	
+	if (node == NULL || length > node->length){
+		brelse(node);
+		return -1;
+	}
+	/* the index node stays pinned while the bitmap is changed */
+	keep = (length+FOUR_KB-1)/FOUR_KB;
+	total = 0;
+	for (i=0;i<node->num_extents;i++){
+		if (total + node->extents[i].count <= keep){
+			total += node->extents[i].count;
+			continue;
+		}
+		kept = (keep > total) ? keep-total : 0;
+		free_run(fs, node->extents[i].start + kept, node->extents[i].count - kept);
+		node->extents[i].count = kept;
+		total += kept;
+	}
+	while (node->num_extents > 0 && node->extents[node->num_extents-1].count == 0){
+		node->num_extents--;
+	}
+	
+	/* the rest of the last block reads as zero if the file grows again */
+	if (length%FOUR_KB != 0){
+		block = map_block(fs, (index_node_t*)node, length/FOUR_KB, 1, &run);
+		if (block >= 0 && (addr = data_block_addr(fs, block)) != NULL){
+			memset(addr + length%FOUR_KB, 0, FOUR_KB - length%FOUR_KB);
+			data_block_dirty(fs, block);
+			brelse(addr);
+		}
+	}
+	node->length = length;
+	bdirty(fs->dev, inode + 1);
+	brelse(node);
+	program_cache_drop(id);
+	return 0;
+}
+
+/* int32_t truncate_data()
+ * Task: cut a file down to length, the blocks past the new end go back to the bitmap
+ * Input : id-------the file id of the file
+ *		   length---the new length, at most the current one
+ * Output: success return 0, otherwise return -1
+ */
+int32_t truncate_data (uint32_t id, uint32_t length){
+	fs_t* fs = id_fs(id);
+	int32_t ret;
+	
+	if (fs == NULL){
+		return -1;
+	}
+	fs_lock(fs);
+	ret = truncate_file(fs, id, length);
+	fs_unlock(fs);
+	return ret;
+}
+
+/* int32_t add_dentry()
+ * Task: write a new dentry into the directory on the image, the boot block first,
+ *		 then the chained directory blocks, a new directory block is added once they are all full
+ * Input : fs-------the image
+ *		   entry----the new dentry
+ * Output: success return 0, otherwise return -1
+ */
+static int32_t add_dentry(fs_t* fs, const dentry_t* entry){
+	boot_block_t* boot;
+	dir_block_t* dir_block;
+	uint32_t block = 0, got, hops = 0;
+	int32_t new_block;
+	
+	if (fs->boot_block.num_dir_entries < MAX_DIR_ENTRIES){
+		boot = (boot_block_t*)bread(fs->dev, 0);
+		if (boot == NULL){
+			return -1;
+		}
+		boot->dir_entries[boot->num_dir_entries++] = *entry;
+		bdirty(fs->dev, 0);
+		brelse(boot);
+		fs->boot_block.dir_entries[fs->boot_block.num_dir_entries++] = *entry;
+		return 0;
+	}
+	
+	/* find the last directory block of the chain, a chain longer than MAX_DIR_BLOCKS loops back */
+	if (fs_feature(fs, FS_FEATURE_DIR_CHAIN) && fs->boot_block.dir_next != 0){
+		block = fs->boot_block.dir_next;
+		while ((dir_block = (dir_block_t*)data_block_addr(fs, block)) != NULL){
+			if (++hops > MAX_DIR_BLOCKS){
+				brelse(dir_block);
+				return -1;
+			}
+			if (dir_block->num_dir_entries < MAX_DIR_ENTRIES){
+				dir_block->dir_entries[dir_block->num_dir_entries++] = *entry;
+				data_block_dirty(fs, block);
+				brelse(dir_block);
+				return 0;
+			}
+			if (dir_block->dir_next == 0){
+				brelse(dir_block);
+				break;
+			}
+			new_block = dir_block->dir_next;
+			brelse(dir_block);
+			block = new_block;
+		}
+	}
+	
+	/* data block 0 is always in use on a writable image, so a new block never ends the chain */
+	new_block = alloc_run(fs, block+1, 1, &got);
+	if (new_block <= 0){
+		return -1;
+	}
+	dir_block = (dir_block_t*)data_block_addr(fs, new_block);
+	if (dir_block == NULL){
+		free_run(fs, new_block, 1);
+		return -1;
+	}
+	dir_block->num_dir_entries = 1;
+	dir_block->dir_entries[0] = *entry;
+	data_block_dirty(fs, new_block);
+	brelse(dir_block);
+	
+	if (block == 0){
+		boot = (boot_block_t*)bread(fs->dev, 0);
+		if (boot == NULL){
+			return -1;
+		}
+		boot->features |= FS_FEATURE_DIR_CHAIN;
+		boot->dir_next = new_block;
+		bdirty(fs->dev, 0);
+		brelse(boot);
+		fs->boot_block.features |= FS_FEATURE_DIR_CHAIN;
+		fs->boot_block.dir_next = new_block;
+	}
+	else{
+		dir_block = (dir_block_t*)data_block_addr(fs, block);
+		if (dir_block == NULL){
+			return -1;
+		}
+		dir_block->dir_next = new_block;
+		data_block_dirty(fs, block);
+		brelse(dir_block);
+	}
+	return 0;
+}
+
+/* int32_t make_file()
+ * Task: create_file once the image is held by fs_lock, so the name and the inode are still free when taken
+ * Input : fs-------the image
+ *		   fname----the name of the file
+ *		   name-----the name past the mount prefix
+ * Output: same as create_file
+ */
+static int32_t make_file (fs_t* fs, const uint8_t* fname, const uint8_t* name){
+	uint32_t length, inode, i;
+	dentry_t entry;
+	extent_node_t* node;
+	
+	length = strlen((int8_t*)name);
+	if (!fs_writable(fs) || length == 0){
+		return -1;
+	}
+	if (read_dentry_by_name(fname, &entry) == 0){
+		return (entry.file_type == 2) ? truncate_file(fs, entry.inode, 0) : -1;
+	}
+	/* new files only go to the root directory, subdirectories are written by createfs */
+	for (i=0;i<length;i++){
+		if (name[i] == PATH_SEPARATOR){
+			return -1;
+		}
+	}
+	if (length > MAX_NAME_LENGTH){
+		return -1;
+	}
+	if (fs->num_dentries == MAX_DENTRIES){
+		return -1;
+	}
+	
+	/* inode 0 is the empty inode of "." and "rtc" */
+	for (inode=1;inode<fs->boot_block.num_inodes;inode++){
+		if (!bitmap_get(fs, fs->boot_block.inode_bitmap, inode)){
+			break;
+		}
+	}
+	if (inode == fs->boot_block.num_inodes){
+		return -1;
+	}
+	
+	memset(&entry, 0, sizeof(entry));
+	memcpy(entry.file_name, name, length);
+	entry.file_type = 2;
+	entry.inode = inode;
+	if (add_dentry(fs, &entry) != 0){
+		return -1;
+	}
+	bitmap_set(fs, fs->boot_block.inode_bitmap, inode, 1);
+	node = (extent_node_t*)inode_block_addr(fs, inode);
+	if (node == NULL){
+		return -1;
+	}
+	memset(node, 0, FOUR_KB);
+	node->magic = EXTENT_MAGIC;
+	bdirty(fs->dev, inode + 1);
+	brelse(node);
+	
+	fs->dentry_table[fs->num_dentries] = entry;
+	index_dentry(fs, fs->num_dentries);
+	fs->num_dentries++;
+	return 0;
+}
+
+/* int32_t create_file()
+ * Task: make an empty regular file, an existing one is truncated to 0
+ * Input : fname----the name of the file, on the image mounted at its longest matching prefix
+ * Output: success return 0, otherwise return -1
+ */
+int32_t create_file (const uint8_t* fname){
+	const uint8_t* name;
+	int32_t id, ret;
+	fs_t* fs;
+	
+	id = mount_lookup(fname, MOUNT_IMAGE, &name);
+	if (id < 0 || (fs = id_fs(FILE_ID(id, 0))) == NULL){
+		return -1;
+	}
+	fs_lock(fs);
+	ret = make_file(fs, fname, name);
+	fs_unlock(fs);
+	return ret;
+}
+
+ /* int32_t fs_slot()
+ * Task: choose the entry of fs_table for an image mounted at a prefix,
+ *		 the root image is always FS_ROOT, an image mounted again reuses its entry
+ * Input : prefix----the mount prefix
+ * Output: the entry, -1 if fs_table is full
+ */
+static int32_t fs_slot(const uint8_t* prefix){
+	const uint8_t* rest;
+	int32_t n;
+	
+	if (prefix[0] == '\0'){
+		return FS_ROOT;
+	}
+	n = mount_lookup(prefix, MOUNT_IMAGE, &rest);
+	if (n > FS_ROOT && *rest == '\0'){
+		return n;
+	}
+	for (n=FS_ROOT+1;n<MAX_FS;n++){
+		if (!fs_table[n].used){
+			return n;
+		}
+	}
+	return -1;
+}
+
+ /* void verify_image()
+ * Task: compare every block the checksum table covers with its CRC32C and flag the bad ones,
+ *		 reads then fail on a bad block instead of returning what is in it
+ * Input : fs----the image, its boot block already copied
+ * Output: None
+ */
+static void verify_image(fs_t* fs){
+	uint32_t covered, block, expected, sum, start;
+	uint32_t* table;
+	uint8_t* data;
+	
+	memset(&fs->check, 0, sizeof(fs->check));
+	memset(fs->bad_blocks, 0, sizeof(fs->bad_blocks));
+	if (!fs_feature(fs, FS_FEATURE_CHECKSUMS)){
+		return;
+	}
+	covered = fs->boot_block.num_inodes + fs->boot_block.checksum_table;
+	if (fs->boot_block.checksum_table >= fs->boot_block.num_data_blocks){
+		return;
+	}
+	if (covered >= MAX_CHECKED_BLOCKS){
+		covered = MAX_CHECKED_BLOCKS - 1;
+	}
+	
+	start = rdtsc();
+	for (block=1;block<=covered;block++){
+		/* a device streams the blocks in, the table block is looked up again as buffers get reused */
+		if ((block-1) % (BLOCK_CACHE_SIZE/2) == 0){
+			block_read_ahead(fs->dev, block, BLOCK_CACHE_SIZE/2);
+		}
+		table = (uint32_t*)data_block_addr(fs, fs->boot_block.checksum_table + (block-1)/BLOCK_POINTERS);
+		if (table == NULL){
+			break;
+		}
+		expected = table[(block-1)%BLOCK_POINTERS];
+		brelse(table);
+		data = bread(fs->dev, block);
+		sum = (data == NULL) ? 0 : crc32c(data, FOUR_KB);
+		brelse(data);
+		if (data == NULL || sum != expected){
+			fs->bad_blocks[block/32] |= 1 << (block%32);
+			fs->check.bad_blocks++;
+		}
+		fs->check.checked_blocks++;
+	}
+	fs->check.cycles = rdtsc() - start;
+	fs->check.hw = crc32c_hw;
+}
+
+ /* const fs_check_t* fs_check()
+ * Task: get what the verify pass found on a mounted image
+ * Input : n----the number of the image in file ids
+ * Output: the result, NULL if nothing is mounted there or the image has no checksums
+ */
+const fs_check_t* fs_check(uint32_t n){
+	fs_t* fs;
+	
+	if (n >= MAX_FS || (fs = id_fs(FILE_ID(n, 0))) == NULL || !fs_feature(fs, FS_FEATURE_CHECKSUMS)){
+		return NULL;
+	}
+	return &fs->check;
+}
+
+ /* int32_t mount_image()
+ * Task: read the image on a device and mount it at a prefix, replacing what was mounted there
+ *		 if the device holds no image the prefix is left with nothing mounted
+ * Input : prefix----"" for the root image, otherwise a prefix ending with '/' (see mount.h)
+ *		   dev-------the device holding the image, num_blocks is at most the size of the device
+ * Output: success return the number of the image in file ids, -1 if the device holds no image
+ */
+int32_t mount_image(const uint8_t* prefix, block_dev_t* dev){
+	 int32_t n = fs_slot(prefix);
+	 uint8_t* block;
+	 boot_block_t* image;
+	 fs_t* fs;
+	 
+	 if (n < 0){
+		 return -1;
+	 }
+	 fs = &fs_table[n];
+	 /* nothing cached may outlive the old image */
+	 if (fs->used){
+		 fs->used = 0;
+		 block_cache_forget(fs->dev);
+	 }
+	 memset(lz4_cache, 0, sizeof(lz4_cache));
+	 
+	 block = bread(dev, 0);
+	 if (block == NULL){
+		 return -1;
+	 }
+	 image = (boot_block_t*) block;
+	 if (1 + image->num_inodes + image->num_data_blocks > dev->num_blocks || image->num_dir_entries > MAX_DIR_ENTRIES){
+		 brelse(block);
+		 return -1;
+	 }
+	 dev->num_blocks = 1 + image->num_inodes + image->num_data_blocks;
+	 
+	 memcpy(&fs->boot_block, block, sizeof(fs->boot_block));
+	 brelse(block);
+	 fs->dev = dev;
+	 verify_image(fs);
+	 build_dentry_table(fs);
+	 build_dentry_index(fs);
+	 if (mount_add(prefix, MOUNT_IMAGE, n) != 0){
+		 return -1;
+	 }
+	 fs->used = 1;
+	 if (n == FS_ROOT){
+		 bootBlock = &fs->boot_block;
+		 dir_number = 0;
+	 }
+	 return n;
+ }
+
+ /* int32_t mount_module()
+ * Task: mount an image that is a multiboot module, it is read in place
+ * Input : prefix----the mount prefix, see mount_image
+ *		   addr------address of the module
+ * Output: success return the number of the image in file ids, otherwise -1
+ */
+int32_t mount_module(const uint8_t* prefix, uint32_t addr){
+	 boot_block_t* image = (boot_block_t*) addr;
+	 int32_t n = fs_slot(prefix);
+	 block_dev_t* dev;
+	 
+	 if (n < 0){
+		 return -1;
+	 }
+	 dev = &fs_table[n].memory_dev;
+	 dev->base = (uint8_t*) addr;
+	 dev->num_blocks = 1 + image->num_inodes + image->num_data_blocks;
+	 dev->read_blocks = NULL;
+	 dev->write_blocks = NULL;
+	 dev->read_async = NULL;
+	 dev->poll = NULL;
+	 return mount_image(prefix, dev);
+ }
+
  /* void init_file_system()
- * Task: initialize every global variable used in this driver
- * Input : 
+ * Task: initialize every global variable used in this driver, the root image is the multiboot module
+ * Input : bootBlock_addr----address of the module
  * Output: None
  */
 void init_file_system(uint32_t bootBlock_addr){
-	 
-	 /* initialize */
-	 bootBlock = (boot_block_t*) bootBlock_addr;
-	 dir_number = 0;
+	 mount_module((const uint8_t*)"", bootBlock_addr);
+ }
+
+ /* int32_t init_file_system_dev()
+ * Task: initialize every global variable used in this driver, the root image is read from a device
+ * Input : dev----the device holding the image, num_blocks is at most the size of the device
+ * Output: success return 0, -1 if the device holds no image
+ */
+int32_t init_file_system_dev(block_dev_t* dev){
+	 return (mount_image((const uint8_t*)"", dev) < 0) ? -1 : 0;
  }
 
 
@@ -150,9 +1575,60 @@ int32_t file_open (const uint8_t* filename){
  * Output: return 0
  */
 int32_t file_close (int32_t fd){
+	/* the writes of the file reach the device in one batch */
+	block_flush();
 	return 0;
 }
 
+/* void read_ahead(): grow the read-ahead window of a file read sequentially and read the blocks
+ *					   that follow, any other access closes the window
+ * Input : fs		--	the image
+ *		   inode	--	the inode of the file
+ *		   file		--	the file descriptor
+ *		   offset	--	where the read started
+ *		   count	--	number of bytes read
+ * Output: None
+ */
+static void read_ahead(fs_t* fs, uint32_t inode, file_desc_t* file, uint32_t offset, uint32_t count){
+	uint32_t file_block, remaining, run;
+	int32_t block;
+	index_node_t* inode_block;
+	
+	if (offset == file->ra_next){
+		file->ra_window = (file->ra_window == 0) ? READ_AHEAD_MIN : file->ra_window*2;
+		if (file->ra_window > READ_AHEAD_MAX){
+			file->ra_window = READ_AHEAD_MAX;
+		}
+	}
+	else{
+		file->ra_window = 0;
+	}
+	file->ra_next = offset+count;
+	
+	/* a memory-resident image is never read ahead */
+	if (file->ra_window == 0 || fs->dev->base != NULL){
+		return;
+	}
+	file_block = (offset+count)/FOUR_KB;
+	remaining = file->ra_window;
+	while (remaining>0){
+		inode_block = inode_block_addr(fs, inode);
+		/* the blocks of a compressed file aren't where its offsets say */
+		if (inode_block == NULL || file_block*FOUR_KB >= inode_block->length || is_compressed(fs, inode_block)){
+			brelse(inode_block);
+			return;
+		}
+		block = map_block(fs, inode_block, file_block, remaining, &run);
+		brelse(inode_block);
+		if (block<0){
+			return;
+		}
+		block_read_ahead(fs->dev, fs->boot_block.num_inodes + 1 + block, run);
+		file_block += run;
+		remaining -= run;
+	}
+}
+
 /* int32_t file_read(): read files filename by filename, including “.”
  * Input : fd		--	file descriptor
  *		   buf		--	passed buffer
@@ -166,18 +1642,38 @@ int32_t file_read (int32_t fd, void* buf, int32_t nbytes){
 	uint32_t offset = pcb->fd_table[fd].file_position;
 	uint32_t inode = pcb->fd_table[fd].inode;
 	// read data
-	uint32_t num_data = read_data(inode,offset,(uint8_t*)buf,nbytes);
+	int32_t num_data = read_data(inode,offset,(uint8_t*)buf,nbytes);
+	// a failed read leaves the position where it was
+	if (num_data < 0){
+		return -1;
+	}
 	// move to next position of the data
 	pcb->fd_table[fd].file_position+=num_data;
+	if (num_data > 0){
+		read_ahead(id_fs(inode), ID_INODE(inode), &pcb->fd_table[fd], offset, num_data);
+	}
 	
 	return num_data;
 }
 
-/* int32_t file_write(): do nothing
- * Output: return -1
+/* int32_t file_write(): write at the file position, the file grows as needed
+ * Input : fd		--	file descriptor
+ *		   buf		--	the data
+ *		   nbytes	--	number of bytes to write
+ * Output: return the number of bytes written, -1 if the file can't be written
  */
 int32_t file_write (int32_t fd, const void* buf, int32_t nbytes){
-	return -1;
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	int32_t written;
+	
+	if (buf == NULL || nbytes < 0){
+		return -1;
+	}
+	written = write_data(pcb->fd_table[fd].inode, pcb->fd_table[fd].file_position, (const uint8_t*)buf, nbytes);
+	if (written > 0){
+		pcb->fd_table[fd].file_position += written;
+	}
+	return written;
 }
 
 /* int32_t dir_open(): initialize any temporary structures
@@ -197,32 +1693,74 @@ int32_t dir_close (int32_t fd){
 }
 
 /* int32_t dir_read(): read files filename by filename, including “.”
+ *					  the position in the directory is kept in the file descriptor
  * Input : fd		--	file descriptor
  *		   buf		--	passed buffer
  *		   nbytes	--	number of bytes need to be copied
  * Output: return the length of filename, otherwise return -1
  */
 int32_t dir_read (int32_t fd, void* buf, int32_t nbytes){
-	/* reading finished, reset */
+	pcb_t* pcb = get_specific_pcb(cur_pid);
 	
 	/* check the dentry */
 	dentry_t dentry;
 	
-	if (read_dentry_by_index(dir_number,&dentry) == 0){
-		uint32_t length = strlen((int8_t*)dentry.file_name);		// get the length
-		if (length>=MAX_NAME_LENGTH){
-			length = MAX_NAME_LENGTH;
+	if (read_dentry_in_dir(pcb->fd_table[fd].inode,pcb->fd_table[fd].file_position,&dentry) == 0){
+		uint32_t length = name_length(dentry.file_name);		// get the length
+		if (length>nbytes){
+			length = nbytes;
 		}
 		strncpy((int8_t*)buf, (int8_t*)dentry.file_name, length);	// copy to buf
-		dir_number++;												// move to next dir
+		pcb->fd_table[fd].file_position++;							// move to next dir
 		return length;
 	}
 	else{
-		dir_number = 0;		// move to the end
+		pcb->fd_table[fd].file_position = 0;		// reading finished, reset
 		return 0;
 	}
 }
 
+/* int32_t dir_getdents(): fill buf with as many dirent_t records as fit,
+ *						   sharing the position in the directory with dir_read
+ * Input : fd		--	file descriptor of an open directory
+ *		   buf		--	passed buffer
+ *		   nbytes	--	size of buf in bytes
+ * Output: return the number of bytes filled, 0 at the end of the directory,
+ *		   -1 if buf can't hold one record
+ */
+int32_t dir_getdents (int32_t fd, void* buf, int32_t nbytes){
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	dirent_t* record = (dirent_t*)buf;
+	dentry_t dentry;
+	uint32_t length;
+	int32_t filled = 0;
+	
+	if (nbytes < (int32_t)sizeof(dirent_t)){
+		return -1;
+	}
+	
+	while (nbytes-filled >= (int32_t)sizeof(dirent_t)
+		   && read_dentry_in_dir(pcb->fd_table[fd].inode,pcb->fd_table[fd].file_position,&dentry) == 0){
+		length = name_length(dentry.file_name);
+		memcpy(record->file_name, dentry.file_name, length);
+		record->file_name[length] = '\0';
+		record->inode = dentry.inode;
+		record->file_type = dentry.file_type;
+		record->size = 0;
+		if (dentry.file_type == 2){
+			record->size = file_length(dentry.inode);
+		}
+		record++;
+		filled += sizeof(dirent_t);
+		pcb->fd_table[fd].file_position++;
+	}
+	
+	if (filled == 0){
+		pcb->fd_table[fd].file_position = 0;		// reading finished, reset
+	}
+	return filled;
+}
+
 /* int32_t dir_write(): do nothing
  * Output: return -1
  */
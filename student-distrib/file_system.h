@@ -7,8 +7,50 @@
 
 #include "types.h"
 #include "syscall_handler.h"
+#include "block_cache.h"
 #define MAX_NAME_LENGTH 32
 #define FOUR_KB 4096
+#define MAX_DIR_ENTRIES 63
+#define MAX_EXTENTS 510
+#define MAX_DIRECT_BLOCKS 1020
+#define BLOCK_POINTERS 1024			// data block numbers in one indirect block
+#define MAX_DENTRIES 1024			// dentries over the boot block and all chained directory blocks
+#define MAX_DIR_BLOCKS (MAX_DENTRIES/MAX_DIR_ENTRIES + 1)	// chained directory blocks followed, a longer chain is a loop
+
+/* on-image format features */
+#define FS_MAGIC 0x33394653				// "FS93"
+#define FS_FEATURE_EXTENTS 0x1			// some index nodes are extent_node_t
+#define FS_FEATURE_INDIRECT 0x2			// some index nodes are indirect_node_t
+#define FS_FEATURE_DIR_CHAIN 0x4		// the directory continues in dir_block_t data blocks
+#define FS_FEATURE_WRITABLE 0x8			// inode and data block bitmaps, needs FS_FEATURE_EXTENTS
+#define FS_FEATURE_LZ4 0x10				// some extent index nodes have EXTENT_FLAG_LZ4
+#define FS_FEATURE_SUBDIRS 0x20			// directory entries with an inode are subdirectories
+#define FS_FEATURE_CHECKSUMS 0x40		// a CRC32C of every index node and data block, see checksum_table
+#define EXTENT_MAGIC 0x544E5845			// "EXNT"
+#define INDIRECT_MAGIC 0x444E4901		// "\1IND"
+#define BITS_PER_BLOCK (FOUR_KB*8)		// bitmap bits in one data block
+#define MAX_CHECKED_BLOCKS 65536		// image blocks verified at mount (256MB), the rest are trusted
+#define EXTENT_FLAG_LZ4 0x1				// the extents hold an LZ4 stream, see below
+#define SUBDIR_MAGIC 0x52494453			// "SDIR"
+#define PATH_SEPARATOR '/'
+
+/* decompressed blocks kept for the next read of a compressed file */
+#define LZ4_CACHE_SIZE 4
+
+/* dentry name index: power of two, at least twice MAX_DENTRIES */
+#define DENTRY_INDEX_SIZE 2048
+#define DENTRY_INDEX_EMPTY 0xFFFF
+#define FNV_OFFSET_BASIS 0x811C9DC5
+#define FNV_PRIME 0x01000193
+
+/* images mounted at once, see mount.h, the root image is always fs FS_ROOT */
+#define MAX_FS 4
+#define FS_ROOT 0
+/* a file id names an inode of one mounted image, ids on the root image are the plain inode numbers */
+#define FS_SHIFT 24
+#define FILE_ID(fs, inode) (((fs) << FS_SHIFT) | (inode))
+#define ID_FS(id) ((id) >> FS_SHIFT)
+#define ID_INODE(id) ((id) & ((1 << FS_SHIFT) - 1))
 
 /* new struct to store every directory entry===>64B in total */
 typedef struct dir_entry{
@@ -23,20 +65,150 @@ typedef struct boot_block{
 	uint32_t num_dir_entries;
 	uint32_t num_inodes;
 	uint32_t num_data_blocks;
-	uint32_t reserved[13];			// 52/4 = 13
-	dentry_t dir_entries[63];		// 4096/64 - 1 = 63
+	uint32_t magic;					// FS_MAGIC if the image uses any FS_FEATURE, 0 on legacy images
+	uint32_t features;				// FS_FEATURE_* flags, only valid with FS_MAGIC
+	uint32_t dir_next;				// FS_FEATURE_DIR_CHAIN: data block of the next dir_block_t
+	uint32_t inode_bitmap;			// FS_FEATURE_WRITABLE: data block of the inode bitmap, 1 bit per inode
+	uint32_t block_bitmap;			// FS_FEATURE_WRITABLE: first data block of the data block bitmap
+	uint32_t checksum_table;		// FS_FEATURE_CHECKSUMS: first data block of the CRC32C of image blocks
+									// 1 .. num_inodes+checksum_table, BLOCK_POINTERS per data block
+	uint32_t reserved[7];			// 28/4 = 7
+	dentry_t dir_entries[MAX_DIR_ENTRIES];		// 4096/64 - 1 = 63
 } boot_block_t;
 
+/* new struct to store a chained directory block ===>4kB in total, lives in a data block */
+typedef struct dir_block{
+	uint32_t num_dir_entries;		// entries in this block
+	uint32_t dir_next;				// data block of the next dir_block_t, 0 for the last one
+	uint32_t reserved[14];			// 56/4 = 14
+	dentry_t dir_entries[MAX_DIR_ENTRIES];
+} dir_block_t;
+
+/* new struct at the start of a subdirectory ===>64B in total, the size of a dentry
+ * a subdirectory is a file of its own inode, so it is read like any file:
+ *   subdir_header_t				this header
+ *   dentry_t entries[num_entries]	"." (the directory itself), ".." (its parent, inode 0 for the root), then the files
+ *   uint32_t slots[hash_size]		only for large directories, open-addressing index by name_hash with
+ *									linear probing, a slot holds the index in entries + 1, 0 if empty */
+typedef struct subdir_header{
+	uint32_t magic;					// SUBDIR_MAGIC
+	uint32_t num_entries;
+	uint32_t hash_size;				// power of two, 0 when the directory has no index
+	uint32_t reserved[13];			// 52/4 = 13
+} subdir_header_t;
+
+/* new struct for one record filled by getdents ===>48B in total */
+typedef struct dirent{
+	uint32_t inode;
+	uint32_t file_type;
+	uint32_t size;					// file length, 0 for rtc and directories
+	int8_t file_name[MAX_NAME_LENGTH+1];	// always null terminated
+	uint8_t reserved[3];			// keep records 4B aligned
+} dirent_t;
+
+/* new struct filled by stat and fstat ===>12B in total */
+typedef struct stat{
+	uint32_t inode;					// file id, or the node of a tmpfs file
+	uint32_t file_type;				// 0 rtc, 1 directory, 2 regular file
+	uint32_t size;					// file length, 0 for rtc and directories
+} stat_t;
+
+/* new struct for one slot of the dentry name index */
+typedef struct dentry_index{
+	uint32_t hash;					// hash of the name
+	uint16_t index;					// index in dentry_table, DENTRY_INDEX_EMPTY if unused
+	uint8_t length;					// precomputed length of the name
+} dentry_index_t;
+
 /* new struct to store every index nodes ===>4kB in total */
 typedef struct index_node{
 	uint32_t length;
 	uint32_t data_block[1023];		// (4KB/4B) - 1 = 1023
 } index_node_t;
 
+/* new struct for a run of contiguous data blocks */
+typedef struct extent{
+	uint32_t start;					// first data block of the run
+	uint32_t count;					// number of data blocks in the run
+} extent_t;
+
+/* new struct to store an extent-based index node ===>4kB in total
+ * only used when the boot block has FS_FEATURE_EXTENTS, and told apart
+ * from a legacy index node by EXTENT_MAGIC in the second word */
+typedef struct extent_node{
+	uint32_t length;
+	uint32_t magic;					// EXTENT_MAGIC
+	uint32_t flags;					// EXTENT_FLAG_*, 0 for plain data
+	uint32_t num_extents;
+	extent_t extents[MAX_EXTENTS];	// (4KB-16B)/8B = 510, in file order
+} extent_node_t;
+
+/* the LZ4 stream of a compressed file, length stays the uncompressed length:
+ *   uint32_t offset[blocks+1]	where every 4KB block of the file starts in the stream
+ *   block k					bytes offset[k] .. offset[k+1] of the stream, one LZ4 block,
+ *								kept as is if it is as long as the uncompressed block */
+
+/* new struct for one decompressed block of a compressed file */
+typedef struct lz4_block{
+	uint32_t inode;					// file id
+	uint32_t file_block;
+	uint32_t valid;					// 1->holds the block, 0->empty
+	volatile uint32_t busy;			// 1->being decompressed or copied from
+	uint32_t last_use;				// the least recently used one is reused first
+	uint8_t input[FOUR_KB];			// the stored block while it is decompressed
+	uint8_t data[FOUR_KB];
+} lz4_block_t;
+
+/* new struct to store an index node with indirect blocks ===>4kB in total
+ * only used when the boot block has FS_FEATURE_INDIRECT, and told apart
+ * from a legacy index node by INDIRECT_MAGIC in the second word
+ * file blocks:  0 .. 1019                  data_block[]
+ *               1020 .. 2043               single_indirect -> 1024 data blocks
+ *               2044 .. 2044+1024*1024-1   double_indirect -> 1024 single indirect blocks */
+typedef struct indirect_node{
+	uint32_t length;
+	uint32_t magic;					// INDIRECT_MAGIC
+	uint32_t single_indirect;		// data block holding BLOCK_POINTERS data block numbers
+	uint32_t double_indirect;		// data block holding BLOCK_POINTERS single indirect blocks
+	uint32_t data_block[MAX_DIRECT_BLOCKS];		// (4KB-16B)/4B = 1020
+} indirect_node_t;
+
+/* new struct for what the mount-time verify pass found */
+typedef struct fs_check{
+	uint32_t checked_blocks;		// image blocks whose checksum was compared
+	uint32_t bad_blocks;			// blocks that didn't match, they read as missing
+	uint32_t cycles;				// time stamp counter ticks the pass took
+	uint32_t hw;					// 1 if the crc32 instruction was used
+} fs_check_t;
+
+/* new struct for one mounted image */
+typedef struct fs{
+	uint32_t used;					// 1->mounted, 0->free entry
+	block_dev_t* dev;				// the device holding the image
+	block_dev_t memory_dev;			// the device of an image that is a multiboot module
+	boot_block_t boot_block;		// kernel copy of the boot block
+	dentry_t dentry_table[MAX_DENTRIES];	// boot block first, then the chained directory blocks
+	uint32_t num_dentries;
+	dentry_index_t dentry_index[DENTRY_INDEX_SIZE];	// open-addressing index over dentry_table
+	fs_check_t check;
+	uint32_t bad_blocks[MAX_CHECKED_BLOCKS/32];	// 1 bit per image block that failed its checksum
+	volatile uint32_t writing;		// 1->a process is changing the image, the others wait in fs_lock
+} fs_t;
+
 extern int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
 extern int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
-extern int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+extern int32_t read_dentry_in_dir (uint32_t dir, uint32_t index, dentry_t* dentry);
+extern int32_t read_data (uint32_t id, uint32_t offset, uint8_t* buf, uint32_t length);
 extern void init_file_system(uint32_t bootBlock_addr);
+extern int32_t init_file_system_dev(block_dev_t* dev);
+extern int32_t mount_image(const uint8_t* prefix, block_dev_t* dev);
+extern int32_t mount_module(const uint8_t* prefix, uint32_t addr);
+extern uint32_t file_length (uint32_t id);
+extern uint8_t* file_block_addr (uint32_t id, uint32_t file_block);
+extern int32_t write_data (uint32_t id, uint32_t offset, const uint8_t* buf, uint32_t length);
+extern int32_t truncate_data (uint32_t id, uint32_t length);
+extern int32_t create_file (const uint8_t* fname);
+extern const fs_check_t* fs_check (uint32_t n);
 
 extern int32_t file_open (const uint8_t* filename);
 extern int32_t file_read (int32_t fd, void* buf, int32_t nbytes);
@@ -47,7 +219,10 @@ extern int32_t dir_open (const uint8_t* filename);
 extern int32_t dir_read (int32_t fd, void* buf, int32_t nbytes);
 extern int32_t dir_write (int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t dir_close (int32_t fd);
+extern int32_t dir_getdents (int32_t fd, void* buf, int32_t nbytes);
+
 
+extern fs_t* root_fs;
 
 boot_block_t* bootBlock;
 uint32_t dir_number;
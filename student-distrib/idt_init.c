@@ -23,7 +23,8 @@ void initialize_IDT() {
 		idt[i].reserved0 = 0;
 		idt[i].dpl = 0;
 		idt[i].present = 1;
-		if (i < 32) {
+		/* Page fault keeps interrupt gate, nothing may preempt it before CR2 is read */
+		if (i < 32 && i != 14) {
 			idt[i].reserved3 = 1;		/* Exception uses trap gate */
 		}
 		if (i == 0x80) {
@@ -99,6 +100,7 @@ void set_interrupts() {
 	SET_IDT_ENTRY(idt[40], RTC_handler);
 	SET_IDT_ENTRY(idt[33], KB_handler);
 	SET_IDT_ENTRY(idt[32], PIT_handler);
+	SET_IDT_ENTRY(idt[46], ATA_handler);
 
 	return;
 }
@@ -1,11 +1,15 @@
 #ifndef INTERRUPT_HANDLER_H
 #define INTERRUPT_HANDLER_H
 
+/* the largest valid system call number */
+#define MAX_SYSCALL_NUM 22
+
 #ifndef ASM
 
 extern void RTC_handler();
 extern void KB_handler();
 extern void PIT_handler();
+extern void ATA_handler();
 extern void EXCEPTION_0();
 extern void EXCEPTION_1();
 extern void EXCEPTION_2();
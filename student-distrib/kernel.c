@@ -15,6 +15,11 @@
 #include "file_system.h"
 #include "terminal.h"
 #include "pit.h"
+#include "ata.h"
+#include "page_alloc.h"
+#include "slab.h"
+#include "mount.h"
+#include "tmpfs.h"
 
 //#define RUN_TESTS
 
@@ -22,6 +27,120 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/*
+ * use_ata
+ *		DESCRIPTION: check whether the file system image comes from the disk
+ *		INPUTS: mbi - the multiboot information
+ *		OUTPUTS: none
+ *		RETURN VALUES: 1 if there is no module or the command line has "fs=ata", otherwise 0
+ */
+static int use_ata(multiboot_info_t *mbi) {
+	int8_t* cmdline;
+	
+	if (!CHECK_FLAG(mbi->flags, 3) || mbi->mods_count == 0)
+		return 1;
+	if (!CHECK_FLAG(mbi->flags, 2))
+		return 0;
+	for (cmdline = (int8_t*)mbi->cmdline; *cmdline != '\0'; cmdline++) {
+		if (strncmp(cmdline, "fs=ata", 6) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * mount_modules
+ *		DESCRIPTION: mount every module after the first one that is named on its module line,
+ *					 "module /data_img data" mounts data_img at "data/"
+ *		INPUTS: mbi - the multiboot information
+ *		OUTPUTS: none
+ *		RETURN VALUES: none
+ */
+static void mount_modules(multiboot_info_t *mbi) {
+	uint8_t prefix[MOUNT_PREFIX_LENGTH];
+	module_t* mod = (module_t*)mbi->mods_addr;
+	int8_t* name;
+	uint32_t i, length;
+	
+	if (!CHECK_FLAG(mbi->flags, 3))
+		return;
+	for (i = 1; i < mbi->mods_count; i++) {
+		/* the kernel only reaches the memory it maps 1:1 */
+		if (mod[i].string == 0 || mod[i].mod_end > KERNEL_MAP_LIMIT)
+			continue;
+		/* the second word of the module line */
+		name = (int8_t*)mod[i].string;
+		while (*name != ' ' && *name != '\0')
+			name++;
+		while (*name == ' ')
+			name++;
+		for (length = 0; name[length] != ' ' && name[length] != '\0'; length++);
+		if (length == 0 || length > MOUNT_PREFIX_LENGTH - 2)
+			continue;
+		memcpy(prefix, name, length);
+		prefix[length] = '/';
+		prefix[length + 1] = '\0';
+		if (mount_module(prefix, mod[i].mod_start) < 0)
+			printf("Module %u can't be mounted at %s\n", i, prefix);
+	}
+}
+
+/*
+ * seed_frames
+ *		DESCRIPTION: give the free memory to the frame allocator, the kernel and the modules are kept out,
+ *					 the ranges come from the memory map, or from mem_upper without one
+ *		INPUTS: mbi - the multiboot information
+ *		OUTPUTS: the memory handed to the allocator
+ *		RETURN VALUES: none
+ */
+static void seed_frames(multiboot_info_t *mbi) {
+	module_t* mod = (module_t*)mbi->mods_addr;
+	memory_map_t* mmap;
+	uint32_t i;
+	
+	page_alloc_init();
+	/* the kernel image, its boot stack and everything the boot loader left below it */
+	frame_reserve(0, _8MB);
+	if (CHECK_FLAG(mbi->flags, 3)) {
+		for (i = 0; i < mbi->mods_count; i++)
+			frame_reserve(mod[i].mod_start, mod[i].mod_end);
+	}
+	if (CHECK_FLAG(mbi->flags, 6)) {
+		for (mmap = (memory_map_t *)mbi->mmap_addr;
+				(unsigned long)mmap < mbi->mmap_addr + mbi->mmap_length;
+				mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size))) {
+			/* only available RAM below 4GB */
+			if (mmap->type != 1 || mmap->base_addr_high != 0)
+				continue;
+			frame_add(mmap->base_addr_low, (mmap->length_high != 0) ? FRAME_LIMIT : mmap->base_addr_low + mmap->length_low);
+		}
+	} else if (CHECK_FLAG(mbi->flags, 0)) {
+		/* mem_upper counts the KB above 1MB */
+		frame_add(0x100000, 0x100000 + mbi->mem_upper * 1024);
+	}
+	printf("Frames: %uKB for the kernel, %uKB for user pages\n",
+		frame_stats(ZONE_KERNEL)->free * (FRAME_SIZE / 1024), frame_stats(ZONE_USER)->free * (FRAME_SIZE / 1024));
+}
+
+/*
+ * report_checks
+ *		DESCRIPTION: print what the mount-time verify pass found on every image with checksums
+ *		INPUTS: none
+ *		OUTPUTS: one line per image
+ *		RETURN VALUES: none
+ */
+static void report_checks(void) {
+	const fs_check_t* check;
+	uint32_t n;
+	
+	for (n = 0; n < MAX_FS; n++) {
+		if ((check = fs_check(n)) == NULL)
+			continue;
+		printf("Image %u: %u blocks verified in %u cycles (%s), %u bad\n", n, check->checked_blocks,
+			check->cycles, check->hw ? "crc32" : "table", check->bad_blocks);
+	}
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
@@ -144,14 +263,29 @@ void entry(unsigned long magic, unsigned long addr) {
     }
 
     initialize_IDT();
-    /* Init the PIC */
-	module_t* file_system_mod = (module_t*)mbi->mods_addr; 
-	init_file_system(file_system_mod->mod_start);
-	
-	
     init_paging();
+    seed_frames(mbi);
+    slab_init();
+    process_init();
+    /* Init the PIC */
     i8259_init();
 
+	/* the root image is read from the disk with "fs=ata" on the command line or without a module,
+	 * otherwise it is the first module, the other modules and the tmpfs are mounted next to it */
+	block_cache_init();
+	if (!use_ata(mbi) || ata_init() != 0 || init_file_system_dev(&ata_dev) != 0) {
+		/* without a module there is nothing left to mount the root image from */
+		if (!CHECK_FLAG(mbi->flags, 3) || mbi->mods_count == 0) {
+			printf("No file system: the disk can't be read and there is no module\n");
+			asm volatile ("1: cli; hlt; jmp 1b;");
+		}
+		module_t* file_system_mod = (module_t*)mbi->mods_addr; 
+		init_file_system(file_system_mod->mod_start);
+	}
+	mount_modules(mbi);
+	mount_add((uint8_t*)TMPFS_PREFIX, MOUNT_TMPFS, 0);
+	report_checks();
+
     sti();
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
@@ -11,6 +11,7 @@
 #define ATTRIB_TERM1 0xf
 #define ATTRIB_TERM2 0x3
 #define ATTRIB_TERM3 0x2
+#define IF_FLAG     0x200       // interrupt enable bit of EFLAGS
 
 #include "types.h"
 
@@ -86,6 +87,16 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the low half of the time stamp counter, enough to time
+ * anything shorter than a second or so */
+static inline uint32_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc"
+            : "=a"(low), "=d"(high)
+    );
+    return low;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -109,7 +120,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
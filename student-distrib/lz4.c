@@ -0,0 +1,85 @@
+/* lz4.c - decompress one LZ4 block (the raw block format, no frame header),
+ *		   every length and offset is checked so a corrupt block can't write past dst
+ */
+#include "lz4.h"
+#include "lib.h"
+
+/* int32_t read_length()
+ * Task: add the extra length bytes that follow a nibble of 15
+ * Input : src--------the block
+ *		   src_length-the length of the block
+ *		   ip---------the position in the block, moved past the bytes read
+ *		   length-----the nibble, filled with the whole length
+ * Output: success return 0, -1 if the block ends first
+ */
+static int32_t read_length(const uint8_t* src, uint32_t src_length, uint32_t* ip, uint32_t* length){
+	uint8_t byte;
+	
+	if (*length != LZ4_RUN_MASK){
+		return 0;
+	}
+	do{
+		if (*ip >= src_length){
+			return -1;
+		}
+		byte = src[(*ip)++];
+		*length += byte;
+	} while (byte == 0xFF);
+	return 0;
+}
+
+/* int32_t lz4_decompress()
+ * Task: decompress one LZ4 block
+ * Input : src--------the compressed block
+ *		   src_length-the length of the compressed block
+ *		   dst--------the buffer for the data
+ *		   dst_length-the size of dst
+ * Output: success return the number of bytes in dst, -1 if the block is corrupt or doesn't fit
+ */
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_length, uint8_t* dst, uint32_t dst_length){
+	uint32_t ip = 0, op = 0;
+	uint32_t token, literals, match, offset;
+	
+	while (ip < src_length){
+		token = src[ip++];
+		
+		/* literals, copied as they are */
+		literals = token >> 4;
+		if (read_length(src, src_length, &ip, &literals) != 0 || literals > src_length-ip || literals > dst_length-op){
+			return -1;
+		}
+		memcpy(dst+op, src+ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == src_length){
+			break;					/* the last sequence has no match */
+		}
+		
+		/* match, copied from the data already decompressed */
+		if (src_length-ip < 2){
+			return -1;
+		}
+		offset = src[ip] | (src[ip+1] << 8);
+		ip += 2;
+		match = token & LZ4_RUN_MASK;
+		if (offset == 0 || offset > op || read_length(src, src_length, &ip, &match) != 0){
+			return -1;
+		}
+		match += LZ4_MIN_MATCH;
+		if (match > dst_length-op){
+			return -1;
+		}
+		if (offset >= match){
+			memcpy(dst+op, dst+op-offset, match);
+			op += match;
+		}
+		else{
+			/* the match overlaps the bytes it produces, a run */
+			while (match-- > 0){
+				dst[op] = dst[op-offset];
+				op++;
+			}
+		}
+	}
+	return op;
+}
@@ -0,0 +1,15 @@
+/* lz4.h - Defines for lz4.c
+ *		   used to decompress the LZ4 blocks of compressed files
+ */
+
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#include "types.h"
+
+#define LZ4_MIN_MATCH 4				// the match length in a token is stored minus this
+#define LZ4_RUN_MASK 0xF			// a length nibble of 15 continues in the next bytes
+
+extern int32_t lz4_decompress(const uint8_t* src, uint32_t src_length, uint8_t* dst, uint32_t dst_length);
+
+#endif /* _LZ4_H */
@@ -0,0 +1,68 @@
+/* mount.c - the mount table, every path is on the file system mounted at its longest matching prefix,
+ *			 the root image is mounted at "" so every path has one
+ */
+#include "mount.h"
+#include "lib.h"
+
+static mount_t mount_table[MAX_MOUNTS];
+
+/* int32_t mount_add()
+ * Task: mount a file system at a prefix, what was mounted at the same prefix is replaced
+ * Input : prefix----"" or a name ending with '/', shorter than MOUNT_PREFIX_LENGTH
+ *		   type------MOUNT_*
+ *		   id--------which file system of that type
+ * Output: success return 0, -1 if the prefix is too long or the table is full
+ */
+int32_t mount_add(const uint8_t* prefix, uint32_t type, uint32_t id){
+	uint32_t length = strlen((const int8_t*)prefix);
+	mount_t* entry = NULL;
+	uint32_t i;
+	
+	if (length >= MOUNT_PREFIX_LENGTH || (length > 0 && prefix[length-1] != '/')){
+		return -1;
+	}
+	for (i=0;i<MAX_MOUNTS;i++){
+		if (mount_table[i].type != 0 && mount_table[i].length == length
+			&& strncmp(mount_table[i].prefix, (const int8_t*)prefix, length) == 0){
+			entry = &mount_table[i];
+			break;
+		}
+		if (mount_table[i].type == 0 && entry == NULL){
+			entry = &mount_table[i];
+		}
+	}
+	if (entry == NULL){
+		return -1;
+	}
+	strncpy(entry->prefix, (const int8_t*)prefix, MOUNT_PREFIX_LENGTH);
+	entry->length = length;
+	entry->id = id;
+	entry->type = type;
+	return 0;
+}
+
+/* int32_t mount_lookup()
+ * Task: find the file system a path is on
+ * Input : path----the path given to open, create or execute
+ *		   type----the type of file system the caller handles
+ *		   name----filled with the path without the prefix, may be NULL
+ * Output: the id of the file system, -1 if the path is on nothing mounted or on another type
+ */
+int32_t mount_lookup(const uint8_t* path, uint32_t type, const uint8_t** name){
+	mount_t* best = NULL;
+	uint32_t i;
+	
+	for (i=0;i<MAX_MOUNTS;i++){
+		if (mount_table[i].type != 0 && (best == NULL || mount_table[i].length > best->length)
+			&& strncmp(mount_table[i].prefix, (const int8_t*)path, mount_table[i].length) == 0){
+			best = &mount_table[i];
+		}
+	}
+	if (best == NULL || best->type != type){
+		return -1;
+	}
+	if (name != NULL){
+		*name = path + best->length;
+	}
+	return best->id;
+}
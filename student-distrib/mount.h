@@ -0,0 +1,26 @@
+/* mount.h - Defines for mount.c
+ *			 used to find which file system a path is on
+ */
+
+#ifndef _MOUNT_H
+#define _MOUNT_H
+
+#include "types.h"
+
+#define MAX_MOUNTS 8
+#define MOUNT_PREFIX_LENGTH 16			// a prefix ends with '/', "" is the root image
+#define MOUNT_IMAGE 1					// an image of file_system.c, id is its fs number
+#define MOUNT_TMPFS 2					// the tmpfs of tmpfs.c
+
+/* new struct for one entry of the mount table */
+typedef struct mount{
+	int8_t prefix[MOUNT_PREFIX_LENGTH];
+	uint32_t length;					// length of the prefix
+	uint32_t type;						// MOUNT_*, 0 for a free entry
+	uint32_t id;						// which file system of that type
+} mount_t;
+
+extern int32_t mount_add(const uint8_t* prefix, uint32_t type, uint32_t id);
+extern int32_t mount_lookup(const uint8_t* path, uint32_t type, const uint8_t** name);
+
+#endif /* _MOUNT_H */
@@ -0,0 +1,237 @@
+/* page_alloc.c - a binary buddy allocator of physical frames, seeded by kernel.c from the
+ *				  multiboot memory map; a block of order k is 2^k frames aligned on its size,
+ *				  freeing merges it with its buddy (the block it was split from) while that is free
+ *				  the bookkeeping lives in arrays here, not in the frames, so frames the kernel
+ *				  can't address can be handed out too, and a freed block is never written
+ */
+#include "page_alloc.h"
+#include "lib.h"
+
+static uint8_t frame_state[MAX_FRAMES];				// FRAME_FREE or FRAME_USED | order of the first frame of a block
+static uint32_t frame_next[MAX_FRAMES];				// free lists, doubly linked through the first frame of each block
+static uint32_t frame_prev[MAX_FRAMES];
+static uint32_t frame_present[MAX_FRAMES/32];		// 1 bit per frame given to frame_add
+static uint32_t free_list[NUM_ZONES][FRAME_MAX_ORDER+1];
+static frame_stats_t stats[NUM_ZONES];
+static uint32_t reserved[MAX_RESERVED][2];			// [start, end) of every reserved range
+static uint32_t num_reserved;
+
+/* uint32_t frame_zone()
+ * Task: find the zone of a frame
+ * Input : frame----the frame number
+ * Output: ZONE_KERNEL or ZONE_USER
+ */
+static uint32_t frame_zone(uint32_t frame){
+	return (frame >= KERNEL_MAP_LIMIT/FRAME_SIZE) ? ZONE_USER : ZONE_KERNEL;
+}
+
+/* void list_push()
+ * Task: put a free block on the free list of its order
+ * Input : frame----the first frame of the block
+ *		   order----the order of the block
+ * Output: None
+ */
+static void list_push(uint32_t frame, uint32_t order){
+	uint32_t* head = &free_list[frame_zone(frame)][order];
+	
+	frame_state[frame] = FRAME_FREE | order;
+	frame_prev[frame] = FRAME_NONE;
+	frame_next[frame] = *head;
+	if (*head != FRAME_NONE){
+		frame_prev[*head] = frame;
+	}
+	*head = frame;
+}
+
+/* void list_remove()
+ * Task: take a free block off the free list of its order
+ * Input : frame----the first frame of the block
+ *		   order----the order of the block
+ * Output: None
+ */
+static void list_remove(uint32_t frame, uint32_t order){
+	if (frame_prev[frame] != FRAME_NONE){
+		frame_next[frame_prev[frame]] = frame_next[frame];
+	}
+	else{
+		free_list[frame_zone(frame)][order] = frame_next[frame];
+	}
+	if (frame_next[frame] != FRAME_NONE){
+		frame_prev[frame_next[frame]] = frame_prev[frame];
+	}
+	frame_state[frame] = 0;
+}
+
+/* void page_alloc_init()
+ * Task: start with no memory, kernel.c reserves what is in use and adds the free ranges
+ * Input : None
+ * Output: None
+ */
+void page_alloc_init(void){
+	uint32_t zone, order;
+	
+	memset(frame_state, 0, sizeof(frame_state));
+	memset(frame_present, 0, sizeof(frame_present));
+	for (zone=0;zone<NUM_ZONES;zone++){
+		for (order=0;order<=FRAME_MAX_ORDER;order++){
+			free_list[zone][order] = FRAME_NONE;
+		}
+		stats[zone].total = 0;
+		stats[zone].free = 0;
+	}
+	num_reserved = 0;
+}
+
+/* void frame_reserve()
+ * Task: keep a range of memory out of every later frame_add, for the kernel and the modules
+ * Input : start, end----the range [start, end)
+ * Output: None
+ */
+void frame_reserve(uint32_t start, uint32_t end){
+	if (num_reserved < MAX_RESERVED && start < end){
+		reserved[num_reserved][0] = start;
+		reserved[num_reserved][1] = end;
+		num_reserved++;
+	}
+}
+
+/* void frame_add()
+ * Task: give the whole frames of a free range to the allocator, except the reserved ones,
+ *		 the frames merge into blocks as large as their alignment allows
+ * Input : start, end----the range [start, end), above FRAME_LIMIT is ignored
+ * Output: None
+ */
+void frame_add(uint32_t start, uint32_t end){
+	uint32_t frame, last, i;
+	
+	if (end > FRAME_LIMIT || end < start){
+		end = FRAME_LIMIT;
+	}
+	frame = (start + FRAME_SIZE - 1) / FRAME_SIZE;
+	last = end / FRAME_SIZE;
+	for (;frame<last;frame++){
+		for (i=0;i<num_reserved;i++){
+			if (frame*FRAME_SIZE + FRAME_SIZE > reserved[i][0] && frame*FRAME_SIZE < reserved[i][1]){
+				break;
+			}
+		}
+		/* a frame already in a block (the memory map repeats a range) is added once */
+		if (i < num_reserved || ((frame_present[frame/32] >> (frame%32)) & 1)){
+			continue;
+		}
+		frame_present[frame/32] |= 1 << (frame%32);
+		stats[frame_zone(frame)].total++;
+		frame_state[frame] = FRAME_USED;
+		frame_free(frame*FRAME_SIZE);
+	}
+}
+
+/* uint32_t frame_alloc()
+ * Task: take a block of 2^order frames, the smallest free block that is large enough is split,
+ *		 its halves that aren't needed go back on the free lists
+ * Input : order----the order of the block, FRAME_ORDER_4MB for a 4MB page
+ *		   flags----FRAME_KERNEL if the kernel must reach the block at its physical address,
+ *					otherwise ZONE_USER is tried first so kernel memory lasts longer
+ * Output: the physical address of the block, aligned on its size, 0 if no block is free
+ *		   its content is undefined
+ */
+uint32_t frame_alloc(uint32_t order, uint32_t flags){
+	uint32_t zone, k, frame, i;
+	uint32_t flags_saved;
+	
+	if (order > FRAME_MAX_ORDER){
+		return 0;
+	}
+	cli_and_save(flags_saved);
+	for (i=0;i<NUM_ZONES;i++){
+		zone = (flags & FRAME_KERNEL) ? ZONE_KERNEL : ZONE_USER - i;
+		for (k=order;k<=FRAME_MAX_ORDER;k++){
+			if (free_list[zone][k] != FRAME_NONE){
+				break;
+			}
+		}
+		if (k <= FRAME_MAX_ORDER){
+			frame = free_list[zone][k];
+			list_remove(frame, k);
+			while (k > order){
+				k--;
+				list_push(frame + (1 << k), k);
+			}
+			frame_state[frame] = FRAME_USED | order;
+			stats[zone].free -= 1 << order;
+			restore_flags(flags_saved);
+			return frame*FRAME_SIZE;
+		}
+		if (flags & FRAME_KERNEL){
+			break;
+		}
+	}
+	restore_flags(flags_saved);
+	return 0;
+}
+
+/* void frame_free()
+ * Task: give a block back, merged with its buddy as long as the buddy is a free block of the same order
+ * Input : addr----an address from frame_alloc, anything else (0, twice) is ignored
+ * Output: None
+ */
+void frame_free(uint32_t addr){
+	uint32_t frame = addr / FRAME_SIZE;
+	uint32_t order, buddy;
+	uint32_t flags;
+	
+	if (addr % FRAME_SIZE != 0 || frame >= MAX_FRAMES || !(frame_state[frame] & FRAME_USED)){
+		return;
+	}
+	cli_and_save(flags);
+	order = frame_state[frame] & FRAME_ORDER_MASK;
+	frame_state[frame] = 0;
+	stats[frame_zone(frame)].free += 1 << order;
+	while (order < FRAME_MAX_ORDER){
+		buddy = frame ^ (1 << order);
+		if (frame_state[buddy] != (FRAME_FREE | order)){
+			break;
+		}
+		list_remove(buddy, order);
+		frame &= ~(1 << order);
+		order++;
+	}
+	list_push(frame, order);
+	restore_flags(flags);
+}
+
+/* const frame_stats_t* frame_stats()
+ * Task: count the frames of a zone
+ * Input : zone----ZONE_KERNEL or ZONE_USER
+ * Output: the frames in the zone and the free ones, NULL for a bad zone
+ */
+const frame_stats_t* frame_stats(uint32_t zone){
+	return (zone < NUM_ZONES) ? &stats[zone] : NULL;
+}
+
+/* void* alloc_page()
+ * Task: take one 4KB page of kernel memory, its content is undefined
+ * Input : None
+ * Output: the address of the page, NULL if no memory is left
+ */
+void* alloc_page(void){
+	return (void*)frame_alloc(0, FRAME_KERNEL);
+}
+
+/* void free_page()
+ * Task: give a page back
+ * Input : page----an address from alloc_page, NULL is ignored
+ * Output: None
+ */
+void free_page(void* page){
+	frame_free((uint32_t)page);
+}
+
+/* uint32_t free_pages()
+ * Task: count the pages alloc_page can still hand out
+ * Input : None
+ * Output: the number of free kernel frames
+ */
+uint32_t free_pages(void){
+	return stats[ZONE_KERNEL].free;
+}
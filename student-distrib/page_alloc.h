@@ -0,0 +1,49 @@
+/* page_alloc.h - Defines for page_alloc.c
+ *				  used to hand out physical frames, from 4KB pages to 4MB pages
+ */
+
+#ifndef _PAGE_ALLOC_H
+#define _PAGE_ALLOC_H
+
+#include "types.h"
+
+#define FRAME_SIZE 4096
+#define FRAME_MAX_ORDER 10				// a block of order k is 2^k frames, order 10 is one 4MB page
+#define FRAME_ORDER_4MB FRAME_MAX_ORDER
+#define FRAME_LIMIT 0x10000000			// 256MB, memory above it is never handed out
+#define MAX_FRAMES (FRAME_LIMIT/FRAME_SIZE)
+#define KERNEL_MAP_LIMIT 0x8000000		// 128MB, frames below it are mapped 1:1 for the kernel, see paging.c
+#define MAX_RESERVED 8					// ranges kept out of the allocator, see frame_reserve
+
+/* frame_alloc flags */
+#define FRAME_KERNEL 0x1				// the kernel uses the frame at its physical address
+
+/* a zone is the part of memory a block comes from, blocks never cross KERNEL_MAP_LIMIT */
+#define ZONE_KERNEL 0					// below KERNEL_MAP_LIMIT
+#define ZONE_USER 1						// above, only mapped into user page tables
+#define NUM_ZONES 2
+
+/* frame_state of the first frame of a block, the other frames of a block are 0 */
+#define FRAME_ORDER_MASK 0x0F
+#define FRAME_USED 0x40					// handed out by frame_alloc
+#define FRAME_FREE 0x80					// on the free list of its order
+#define FRAME_NONE 0xFFFFFFFF			// end of a free list
+
+/* new struct for what one zone holds, in frames */
+typedef struct frame_stats{
+	uint32_t total;
+	uint32_t free;
+} frame_stats_t;
+
+extern void page_alloc_init(void);
+extern void frame_reserve(uint32_t start, uint32_t end);
+extern void frame_add(uint32_t start, uint32_t end);
+extern uint32_t frame_alloc(uint32_t order, uint32_t flags);
+extern void frame_free(uint32_t addr);
+extern const frame_stats_t* frame_stats(uint32_t zone);
+
+extern void* alloc_page(void);
+extern void free_page(void* page);
+extern uint32_t free_pages(void);
+
+#endif /* _PAGE_ALLOC_H */
@@ -1,8 +1,14 @@
 /* paging.c - initialize paging */
 
 #include "paging.h"
+#include "page_alloc.h"
+#include "lib.h"
 
 uint32_t page_dir_addr; /* Global variable to refer to the new page directory address */
+tlb_stats_t tlb_stats;
+static tlb_stats_t last_second;		/* the counts when tlb_second last ran */
+/* the vidmap page of every terminal, see remap_vid */
+static PT_t vid_table_array[NUMBER_VID_TABLES] __attribute__((aligned (four_KB)));
 
 /* void init_paging()
  * Inputs: None
@@ -19,64 +25,144 @@ void init_paging() {
 }
 
 /* void remap() 4MB
- * Inputs: virtual_addr - the virtual address of the new task
+ * Inputs: directory - the page directory to change
+ *			virtual_addr - the virtual address of the new task
  *			physical_addr - the physical address to map to
  * Return Value: None
  * Function: map the new program's virtual address to a physical address.
  *			According to the document, the first program will use physical address 8MB and the second will use 12MB
  */
-void remap(int32_t virtual_addr, int32_t physical_addr) {
+void remap(PD_t* directory, int32_t virtual_addr, int32_t physical_addr) {
 	int32_t pde = virtual_addr / four_MB;
 	
 	/* Set up the 4MB page directory entry for program */
-	page_directory_array[0].page_directory[pde].mb.p = 1;			/* set present */
-	page_directory_array[0].page_directory[pde].mb.rw = 1;		/* read or write */
-	page_directory_array[0].page_directory[pde].mb.us = 1;		/* assign the user privilege level */
-	page_directory_array[0].page_directory[pde].mb.pwt = 0;		/* write-back caching is enabled for the associated page or page table */
-	page_directory_array[0].page_directory[pde].mb.pcd = 0;		/* the page or page table can be cached */
-	page_directory_array[0].page_directory[pde].mb.a = 0;			/* a page or page table is initially loaded into physical memory */
-	page_directory_array[0].page_directory[pde].mb.d = 0;			/* when a page is initially loaded into physical memory */
-	page_directory_array[0].page_directory[pde].mb.ps = 1;		/* 1 indicates 4MB */
-	page_directory_array[0].page_directory[pde].mb.g = 0;			/* not global */
-	page_directory_array[0].page_directory[pde].mb.avail = 0;		/* initialize */
-	page_directory_array[0].page_directory[pde].mb.pat = 0;		/* no processor now, so reset to 0 */
-	page_directory_array[0].page_directory[pde].mb.reserved = 0;	/* For a page-directory entry for a 4-MByte page, bits 12 through 21 are reserved and must be set to 0. */
-	page_directory_array[0].page_directory[pde].mb.page_base_addr = physical_addr >> 22;	/* get the address for index===>0x400000 * (0 + 1)  32-22bit equals to (0 + 1) */
+	uint32_t old = directory->page_directory[pde].mb.pointer;
 	
-	flush_TLB();
+	directory->page_directory[pde].mb.p = 1;			/* set present */
+	directory->page_directory[pde].mb.rw = 1;		/* read or write */
+	directory->page_directory[pde].mb.us = 1;		/* assign the user privilege level */
+	directory->page_directory[pde].mb.pwt = 0;		/* write-back caching is enabled for the associated page or page table */
+	directory->page_directory[pde].mb.pcd = 0;		/* the page or page table can be cached */
+	directory->page_directory[pde].mb.a = 0;			/* a page or page table is initially loaded into physical memory */
+	directory->page_directory[pde].mb.d = 0;			/* when a page is initially loaded into physical memory */
+	directory->page_directory[pde].mb.ps = 1;		/* 1 indicates 4MB */
+	directory->page_directory[pde].mb.g = 0;			/* not global */
+	directory->page_directory[pde].mb.avail = 0;		/* initialize */
+	directory->page_directory[pde].mb.pat = 0;		/* no processor now, so reset to 0 */
+	directory->page_directory[pde].mb.reserved = 0;	/* For a page-directory entry for a 4-MByte page, bits 12 through 21 are reserved and must be set to 0. */
+	directory->page_directory[pde].mb.page_base_addr = physical_addr >> 22;	/* get the address for index===>0x400000 * (0 + 1)  32-22bit equals to (0 + 1) */
+	
+	/* one invlpg drops the whole 4MB page, only the loaded directory can have it cached */
+	if ((old & 0x1) && old != directory->page_directory[pde].mb.pointer && (uint32_t)directory == page_dir_addr){
+		flush_page(virtual_addr);
+	}
 	return;
 }
 
 /* void remap_vid() 
- * Inputs: virtual_addr - the virtual address of the new task
+ * Inputs: term_id - the terminal whose vidmap page changes
  *			physical_addr - the physical address to map to
  * Return Value: None
- * Function: Map the given virtual address to video memory (4KB page)
- * video memory maps to kernel also 132MB
+ * Function: Point the vidmap page of a terminal at the video memory while the terminal is shown,
+ *			 or at its backup while it isn't; every process of the terminal maps the same table at VIDMAP_ADDR
+ */
+void remap_vid(uint32_t term_id, int32_t physical_addr) {
+	vid_table_array[term_id].page_table[0].p = 1;		/* set present */
+	vid_table_array[term_id].page_table[0].rw = 1;		/* read or write */
+	vid_table_array[term_id].page_table[0].us = 1;		/* assign the user privilege level */
+	vid_table_array[term_id].page_table[0].page_base_addr = physical_addr>>shift;
+	/* other directories mapping the table aren't loaded, their entries went with the last cr3 load */
+	flush_page(VIDMAP_ADDR);
+	return;
+}
+
+/* PT_t* vid_table()
+ * Inputs: term_id - the terminal
+ * Return Value: the vidmap page table of the terminal, see remap_vid
+ * Function: vidmap points the VIDMAP_ADDR region of a process at it
+ */
+PT_t* vid_table(uint32_t term_id) {
+	return &vid_table_array[term_id];
+}
+
+/* void remap_table()
+ * Inputs: directory - the page directory to change
+ *			virtual_addr - the virtual address of a 4MB region
+ *			table - the page table to use for that region
+ * Return Value: None
+ * Function: Point the 4MB region at a page table (4KB pages) the user can access,
+ *			 the present/read-only bits of every page are up to the table
  */
-void remap_vid(int32_t virtual_addr, int32_t physical_addr) {
-	int32_t pde = virtual_addr / four_MB; //for video memory
+void remap_table(PD_t* directory, int32_t virtual_addr, PT_t* table) {
+	int32_t pde = virtual_addr / four_MB;
+	uint32_t old = directory->page_directory[pde].kb.pointer;
 	
-	page_directory_array[0].page_directory[pde].kb.p = 1;			/* set present */
-	page_directory_array[0].page_directory[pde].kb.rw = 1;		/* read or write */
-	page_directory_array[0].page_directory[pde].kb.us = 1;		/* assign the user privilege level */
-	page_directory_array[0].page_directory[pde].kb.pwt = 0;		/* write-back caching is enabled for the associated page or page table */
-	page_directory_array[0].page_directory[pde].kb.pcd = 0;		/* the page or page table can be cached */
-	page_directory_array[0].page_directory[pde].kb.a = 0;			/* a page or page table is initially loaded into physical memory */
-	page_directory_array[0].page_directory[pde].kb.reserved = 0;	/* set to 0 */
-	page_directory_array[0].page_directory[pde].kb.ps = 0;		/* 0 indicates 4KB */
-	page_directory_array[0].page_directory[pde].kb.g = 0;			/* not global now */
-	page_directory_array[0].page_directory[pde].kb.avail = 0;		/* initialize */
-	page_directory_array[0].page_directory[pde].kb.page_table_base_addr = ((uint32_t)page_table_array[0].page_table >> shift);	/* get the first page_base_address in table 12*/
-	//map video memory
-	page_table_array[0].page_table[0].rw = 1;				/* read or write */
-	page_table_array[0].page_table[0].us = 1;				/* assign the supervisor privilege level */
-	page_table_array[0].page_table[0].p = 1;
-	page_table_array[0].page_table[0].page_base_addr = physical_addr>>shift; // the first page_table, 0xB8 entry --table
-	flush_TLB();
+	directory->page_directory[pde].kb.p = 1;			/* set present */
+	directory->page_directory[pde].kb.rw = 1;		/* read or write, each page table entry decides */
+	directory->page_directory[pde].kb.us = 1;		/* assign the user privilege level */
+	directory->page_directory[pde].kb.pwt = 0;		/* write-back caching is enabled for the associated page or page table */
+	directory->page_directory[pde].kb.pcd = 0;		/* the page or page table can be cached */
+	directory->page_directory[pde].kb.a = 0;			/* a page or page table is initially loaded into physical memory */
+	directory->page_directory[pde].kb.reserved = 0;	/* set to 0 */
+	directory->page_directory[pde].kb.ps = 0;		/* 0 indicates 4KB */
+	directory->page_directory[pde].kb.g = 0;			/* not global */
+	directory->page_directory[pde].kb.avail = 0;		/* initialize */
+	directory->page_directory[pde].kb.page_table_base_addr = ((uint32_t)table->page_table >> shift);
+	/* a region that wasn't present has nothing cached, and only the loaded directory is in the TLB */
+	if ((old & 0x1) && old != directory->page_directory[pde].kb.pointer && (uint32_t)directory == page_dir_addr){
+		flush_range(virtual_addr, NUMBER_ENTRIES);
+	}
 	return;
 }
 
+/* PD_t* new_directory()
+ * Inputs: None
+ * Return Value: a page directory from the frame allocator, NULL if no memory is left
+ * Function: the kernel entries are copied from the kernel directory, they never change after
+ *			 set_up_PD_PT so every directory shares them, the user part starts not present
+ */
+PD_t* new_directory(void) {
+	PD_t* directory = (PD_t*)alloc_page();
+	
+	if (directory == NULL){
+		return NULL;
+	}
+	memcpy(directory->page_directory, page_directory_array[0].page_directory, KERNEL_MAP_END_PDE * sizeof(PDE_t));
+	memset(&directory->page_directory[KERNEL_MAP_END_PDE], 0, (NUMBER_ENTRIES - KERNEL_MAP_END_PDE) * sizeof(PDE_t));
+	return directory;
+}
+
+/* void free_directory()
+ * Inputs: directory - a directory from new_directory, not the loaded one
+ * Return Value: None
+ * Function: give the directory back, the page tables it points at belong to the caller
+ */
+void free_directory(PD_t* directory) {
+	free_page(directory);
+}
+
+/* void load_directory()
+ * Inputs: directory - the page directory to use, NULL for the kernel directory
+ * Return Value: None
+ * Function: switch address spaces with one cr3 load, nothing is done if the directory is in use already
+ */
+void load_directory(PD_t* directory) {
+	if (directory == NULL){
+		directory = &page_directory_array[0];
+	}
+	if ((uint32_t)directory == page_dir_addr){
+		return;
+	}
+	page_dir_addr = (uint32_t)directory;
+	tlb_stats.switches++;
+	asm volatile(
+                 "mov %0, %%cr3;"
+                 :
+                 :"r"(page_dir_addr)
+                 :"memory"
+                 );
+}
+
 /* void set_up_PD_PT()
  * Inputs: None
  * Return Value: None
@@ -101,7 +187,7 @@ void set_up_PD_PT() {
 		page_table_array[0].page_table[i].a = 0;				/* a page or page table is initially loaded into physical memory */
 		page_table_array[0].page_table[i].d = 0;				/* when a page is initially loaded into physical memory */
 		page_table_array[0].page_table[i].pat = 0;				/*  no processor now, so reset to 0 */
-		page_table_array[0].page_table[i].g = 0;				/* not global now */
+		page_table_array[0].page_table[i].g = (i >= VIDEO_ADDR && i <= VIDEO_ADDR + 3);	/* the video pages never change, global */
 		page_table_array[0].page_table[i].avail = 0;			/* initialize */
 		page_table_array[0].page_table[i].page_base_addr = i;	/* store the addr by index */
 	}
@@ -138,16 +224,17 @@ void set_up_PD_PT() {
 	page_directory_array[0].page_directory[1].mb.page_base_addr = 1;	/* get the address for index===>0x400000  32-22bit equals to 1 */
 	
 	/* then initialize the rest not present directory===>4MB */
+	/* the frames page_alloc.c hands out with FRAME_KERNEL are mapped 1:1 for the kernel */
 	for (i=2;i<NUMBER_ENTRIES;i++){
-		page_directory_array[0].page_directory[i].mb.p = 0;			/* not present */
+		page_directory_array[0].page_directory[i].mb.p = (i >= KERNEL_MAP_PDE && i < KERNEL_MAP_END_PDE);	/* present for kernel memory */
 		page_directory_array[0].page_directory[i].mb.rw = 1;		/* read or write */
 		page_directory_array[0].page_directory[i].mb.us = 0;		/* assign the supervisor privilege level */
 		page_directory_array[0].page_directory[i].mb.pwt = 0;		/* write-back caching is enabled for the associated page or page table */
 		page_directory_array[0].page_directory[i].mb.pcd = 0;		/* the page or page table can be cached */
 		page_directory_array[0].page_directory[i].mb.a = 0;			/* a page or page table is initially loaded into physical memory */
 		page_directory_array[0].page_directory[i].mb.d = 0;			/* when a page is initially loaded into physical memory */
-		page_directory_array[0].page_directory[i].mb.ps = 0;		/* 0 indicates 4KB */
-		page_directory_array[0].page_directory[i].mb.g = 0;			/* not global now */
+		page_directory_array[0].page_directory[i].mb.ps = (i >= KERNEL_MAP_PDE && i < KERNEL_MAP_END_PDE);	/* 1 indicates 4MB */
+		page_directory_array[0].page_directory[i].mb.g = (i >= KERNEL_MAP_PDE && i < KERNEL_MAP_END_PDE);	/* kernel memory is the same in every directory */
 		page_directory_array[0].page_directory[i].mb.avail = 0;		/* initialize */
 		page_directory_array[0].page_directory[i].mb.pat = 0;		/* no processor now, so reset to 0 */
 		page_directory_array[0].page_directory[i].mb.reserved = 0;	/* For a page-directory entry for a 4-MByte page, bits 12 through 21 are reserved and must be set to 0. */
@@ -172,11 +259,11 @@ void enable_paging() {
 	"movl %%eax, %%cr3;"			/* cr3===>address */
 	/* set cr4 */
 	"movl %%cr4, %%eax;"
-	"orl $0x00000010, %%eax;"		/* set physical address extension */
+	"orl $0x00000090, %%eax;"		/* set page size extension and page global enable, kernel entries survive cr3 loads */
 	"movl %%eax, %%cr4;"					
 	/* set cr0 */
 	"movl %%cr0, %%eax;"
-	"orl $0x80000000, %%eax;"		/* If 1, enable paging and use the CR3 register, else disable paging */
+	"orl $0x80010000, %%eax;"		/* enable paging and write protect, so the kernel faults on shared read-only user pages too */
 	"movl %%eax, %%cr0;"
 	:								/* no output */
 	:								/* no input */
@@ -188,12 +275,58 @@ void enable_paging() {
 /* void flush_TLB()
  * Inputs: None
  * Return Value: None
- * Function: Flush TLB. We need to reload cr3
+ * Function: Flush TLB. We need to reload cr3, global pages stay
  */
 void flush_TLB() {
+	tlb_stats.full_flushes++;
 	asm volatile(
                  "mov %%cr3, %%eax;"
                  "mov %%eax, %%cr3;"
                  :::"%eax"
                  );
 }
+
+/* void flush_page()
+ * Inputs: virtual_addr - an address in the page whose mapping changed
+ * Return Value: None
+ * Function: drop the TLB entry of one page of the loaded directory, a 4MB page goes as a whole
+ */
+void flush_page(uint32_t virtual_addr) {
+	tlb_stats.page_flushes++;
+	asm volatile(
+                 "invlpg (%0);"
+                 :
+                 :"r"(virtual_addr)
+                 :"memory"
+                 );
+}
+
+/* void flush_range()
+ * Inputs: virtual_addr - the first page whose mapping changed
+ *			count - the number of 4KB pages
+ * Return Value: None
+ * Function: drop the TLB entries of the pages one by one, or all of them once it is cheaper
+ */
+void flush_range(uint32_t virtual_addr, uint32_t count) {
+	uint32_t i;
+	
+	if (count > FLUSH_RANGE_MAX){
+		flush_TLB();
+		return;
+	}
+	for (i=0;i<count;i++){
+		flush_page(virtual_addr + i*four_KB);
+	}
+}
+
+/* void tlb_second()
+ * Inputs: None
+ * Return Value: None
+ * Function: called once a second by the PIT, keeps the counts of the last second in tlb_stats
+ */
+void tlb_second(void) {
+	tlb_stats.full_per_second = tlb_stats.full_flushes - last_second.full_flushes;
+	tlb_stats.pages_per_second = tlb_stats.page_flushes - last_second.page_flushes;
+	tlb_stats.switches_per_second = tlb_stats.switches - last_second.switches;
+	last_second = tlb_stats;
+}
@@ -10,9 +10,14 @@
 #define NUMBER_ENTRIES 1024
 #define four_KB 4096
 #define four_MB 0x400000
-#define NUMBER_PROCESS 4
+#define NUMBER_PROCESS 1		// the kernel directory, every process gets its own from new_directory
+#define NUMBER_VID_TABLES 3		// one vidmap page table per terminal, NUM_TERM in terminal.h
 #define shift 12
 #define VIDEO_ADDR 0xB8
+#define KERNEL_MAP_PDE 2		// 8MB, from here up to the user program the kernel sees memory 1:1
+#define KERNEL_MAP_END_PDE 32	// 128MB, KERNEL_MAP_LIMIT in page_alloc.h
+#define VIDMAP_ADDR 0xC000000	// 192MB, right after the user program, where vidmap maps the page of remap_vid
+#define FLUSH_RANGE_MAX 32		// flush_range invalidates up to this many pages one by one, then flushes the TLB
 
 
 /* align pages (page directory and page tables) on 4 kB boundaries */
@@ -70,7 +75,7 @@ typedef struct PD{
 	PDE_t page_directory[NUMBER_ENTRIES];
 } PD_t;
 
-/* an array to store page_directory for every processor */
+/* the kernel directory, in use until the first process runs and copied into every new directory */
 PD_t page_directory_array[NUMBER_PROCESS] __attribute__((aligned (four_KB)));
 
 
@@ -100,15 +105,43 @@ typedef struct PT{
 /* page table */
 PT_t page_table_array[NUMBER_PROCESS] __attribute__((aligned (four_KB)));
 
+/* new struct to count how often TLB entries are dropped */
+typedef struct tlb_stats{
+	uint32_t full_flushes;			// cr3 reloads of the same directory, drop every entry that isn't global
+	uint32_t page_flushes;			// pages invalidated one by one with invlpg
+	uint32_t switches;				// cr3 loads of another directory
+	uint32_t full_per_second;		// the three counts over the last second, see tlb_second
+	uint32_t pages_per_second;
+	uint32_t switches_per_second;
+} tlb_stats_t;
+
+extern tlb_stats_t tlb_stats;
+
 /* functions */
 void init_paging();
 
-void remap(int32_t virtual_addr, int32_t physical_addr);
+void remap(PD_t* directory, int32_t virtual_addr, int32_t physical_addr);
+
+void remap_vid(uint32_t term_id, int32_t physical_addr);
+
+PT_t* vid_table(uint32_t term_id);
+
+void remap_table(PD_t* directory, int32_t virtual_addr, PT_t* table);
 
-void remap_vid(int32_t virtual_addr, int32_t physical_addr);
+PD_t* new_directory(void);
+
+void free_directory(PD_t* directory);
+
+void load_directory(PD_t* directory);
 
 void flush_TLB();
 
+void flush_page(uint32_t virtual_addr);
+
+void flush_range(uint32_t virtual_addr, uint32_t count);
+
+void tlb_second(void);
+
 void set_up_PD_PT();
 
 void enable_paging();
@@ -8,6 +8,7 @@
 uint32_t running_term = 0;
 uint32_t next_term = 0;
 uint32_t next_process = 0;
+static uint32_t ticks;		// interrupts since the last full second
 
 /*
  * pit_init
@@ -38,6 +39,10 @@ void pit_init(){
 void pit_interrupt_handler(){
 	send_eoi(PIT_IRQ_NUM); //irq 0,send eoi
 	cli();
+	if (++ticks == PIT_HZ) {
+		ticks = 0;
+		tlb_second();
+	}
 	if (term[1].running_pid != -1 || term[2].running_pid != -1) {
 		next_process = get_next_process();
 		schedule(next_process); //current kernal that need to be scheduled to CPU
@@ -57,17 +62,8 @@ void pit_interrupt_handler(){
  */
 void schedule(uint32_t process){
 	
-	// remap video memory of this program (text-mode print)
-	uint8_t* screen_start;
-	vidmap(&screen_start); //132MB
-	
-	// get the new terminal
+	// get the new terminal, its vidmap page already points at the screen or its backup
 	term_info new_terminal = term[next_term];
-	
-	// check if the task belongs to the active terminal
-	if (new_terminal.term_id != curr_term){ //not the active terminal
-		remap_vid((int32_t)screen_start, (int32_t)new_terminal.vid_backup);	// include flush TLB
-	}
 
 		//save tss ss0	
 	term[running_term].esp0 = tss.esp0;
@@ -87,8 +83,8 @@ void schedule(uint32_t process){
 	);
 
 	running_term = next_term;
-	// first map a page from virtual to physical
-	remap(_128MB , _8MB + process*_4MB);
+	// switch to the page directory of the process
+	use_directory((uint8_t)process);
 	// restore tss
 	tss.ss0 = new_terminal.ss0; // KERNEL_DS;
 	tss.esp0 = new_terminal.esp0; //the current process' stack base
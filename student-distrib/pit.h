@@ -18,6 +18,7 @@ extern uint32_t next_process;
 
 #define PIT_MAX_FREQ 1193180
 #define PIT_FREQ 11932
+#define PIT_HZ 100			// interrupts per second, PIT_MAX_FREQ / PIT_FREQ
 #define FREQ_MASK 0xFF
 
 void pit_init();
@@ -0,0 +1,131 @@
+/* program_cache.c - keep the pages of programs loaded, so every instance of
+ *					 a program maps the same frames read-only (copy-on-write)
+ */
+#include "program_cache.h"
+#include "file_system.h"
+#include "page_alloc.h"
+#include "lib.h"
+
+static program_entry_t program_cache[PROGRAM_CACHE_SIZE];
+
+/* void free_entry()
+ * Task: give the frames of an unused entry back to the frame allocator
+ * Input : entry----the cache entry
+ * Output: none
+ */
+static void free_entry(program_entry_t* entry){
+	uint32_t i;
+	
+	for (i=0;i<PROGRAM_MAX_PAGES;i++){
+		free_page((void*)entry->frames[i]);
+	}
+	entry->size = 0;
+}
+
+/* int32_t program_cache_get()
+ * Task: find the cache entry of a program, a new one is made if it isn't cached yet,
+ *		 the caller becomes a user of the entry until program_cache_put
+ * Input : inode----inode of the program
+ *		   size-----length of the image
+ * Output: the cache slot, -1 if the program can't be cached
+ */
+int32_t program_cache_get(uint32_t inode, uint32_t size){
+	int32_t i, slot = -1;
+	
+	if (size == 0 || size > PROGRAM_MAX_PAGES*FOUR_KB){
+		return -1;
+	}
+	for (i=0;i<PROGRAM_CACHE_SIZE;i++){
+		if (program_cache[i].size == size && program_cache[i].inode == inode && !program_cache[i].stale){
+			program_cache[i].users++;
+			return i;
+		}
+		/* prefer an empty entry, otherwise one no process is using */
+		if (program_cache[i].size == 0){
+			slot = i;
+		}
+		else if (program_cache[i].users == 0 && (slot < 0 || program_cache[slot].size != 0)){
+			slot = i;
+		}
+	}
+	if (slot < 0){
+		return -1;
+	}
+	if (program_cache[slot].size != 0){
+		free_entry(&program_cache[slot]);
+	}
+	program_cache[slot].inode = inode;
+	program_cache[slot].size = size;
+	program_cache[slot].users = 1;
+	program_cache[slot].stale = 0;
+	memset(program_cache[slot].frames, 0, sizeof(program_cache[slot].frames));
+	return slot;
+}
+
+/* void program_cache_put()
+ * Task: a process of the program is done, the pages stay cached for the next one
+ * Input : slot----the cache slot from program_cache_get, -1 is ignored
+ * Output: none
+ */
+void program_cache_put(int32_t slot){
+	if (slot >= 0 && slot < PROGRAM_CACHE_SIZE && program_cache[slot].users > 0){
+		program_cache[slot].users--;
+		if (program_cache[slot].users == 0 && program_cache[slot].stale){
+			free_entry(&program_cache[slot]);
+		}
+	}
+}
+
+/* void program_cache_drop()
+ * Task: forget the pages of a program whose file changed, running instances keep theirs
+ * Input : inode----inode of the file
+ * Output: none
+ */
+void program_cache_drop(uint32_t inode){
+	int32_t i;
+	
+	for (i=0;i<PROGRAM_CACHE_SIZE;i++){
+		if (program_cache[i].size != 0 && program_cache[i].inode == inode){
+			if (program_cache[i].users == 0){
+				free_entry(&program_cache[i]);
+			}
+			else{
+				program_cache[i].stale = 1;
+			}
+		}
+	}
+}
+
+/* uint32_t program_cache_page()
+ * Task: get the frame holding one page of the program, it is loaded from the file system on first use
+ * Input : slot----the cache slot
+ *		   page----index of the 4KB page in the image
+ * Output: the physical address of the frame, 0 if no memory is left
+ */
+uint32_t program_cache_page(int32_t slot, uint32_t page){
+	program_entry_t* entry = &program_cache[slot];
+	uint32_t length;
+	uint8_t* addr;
+	
+	if (page >= PROGRAM_MAX_PAGES || page*FOUR_KB >= entry->size){
+		return 0;
+	}
+	if (entry->frames[page] == PROGRAM_NO_FRAME){
+		/* kernel frames are mapped 1:1, so the kernel fills the frame directly */
+		addr = alloc_page();
+		if (addr == NULL){
+			return 0;
+		}
+		length = entry->size - page*FOUR_KB;
+		if (length > FOUR_KB){
+			length = FOUR_KB;
+		}
+		memset(addr, 0, FOUR_KB);
+		if (read_data(entry->inode, page*FOUR_KB, addr, length) < 0){
+			free_page(addr);
+			return 0;
+		}
+		entry->frames[page] = (uint32_t)addr;
+	}
+	return entry->frames[page];
+}
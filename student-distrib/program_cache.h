@@ -0,0 +1,29 @@
+/* program_cache.h - Defines for program_cache.c
+ *					 used to share the pages of programs between processes
+ */
+
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H
+
+#include "types.h"
+
+#define PROGRAM_CACHE_SIZE 8			// programs kept in the cache
+#define PROGRAM_MAX_PAGES 256			// larger programs are loaded privately
+
+/* new struct to store the loaded pages of one program */
+typedef struct program_entry{
+	uint32_t inode;
+	uint32_t size;						// length of the image, 0->entry not in use
+	uint32_t users;						// running processes of this program
+	uint32_t stale;						// 1->the file changed, freed once the last user is done
+	uint32_t frames[PROGRAM_MAX_PAGES];	// kernel frame of every page, PROGRAM_NO_FRAME if not loaded yet
+} program_entry_t;
+
+#define PROGRAM_NO_FRAME 0
+
+extern int32_t program_cache_get(uint32_t inode, uint32_t size);
+extern void program_cache_put(int32_t slot);
+extern uint32_t program_cache_page(int32_t slot, uint32_t page);
+extern void program_cache_drop(uint32_t inode);
+
+#endif /* _PROGRAM_CACHE_H */
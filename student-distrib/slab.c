@@ -0,0 +1,222 @@
+/* slab.c - caches of kernel objects of one size, carved out of slabs from the frame allocator,
+ *			a slab is found from any of its objects by rounding down to SLAB_SIZE, so a free
+ *			doesn't search; kmalloc is a set of caches with power of two sizes
+ */
+#include "slab.h"
+#include "lib.h"
+
+kmem_cache_t* buffer_cache;
+
+static kmem_cache_t caches[MAX_CACHES];
+static kmem_cache_t* kmalloc_caches[KMALLOC_CLASSES];
+static const int8_t* kmalloc_names[KMALLOC_CLASSES] = {
+	"kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512",
+	"kmalloc-1024", "kmalloc-2048", "buffer-4096"
+};
+
+/* void slab_remove()
+ * Task: take a slab off one of the lists of its cache
+ * Input : head----the list
+ *		   slab----the slab
+ * Output: None
+ */
+static void slab_remove(slab_t** head, slab_t* slab){
+	if (slab->prev != NULL){
+		slab->prev->next = slab->next;
+	}
+	else{
+		*head = slab->next;
+	}
+	if (slab->next != NULL){
+		slab->next->prev = slab->prev;
+	}
+}
+
+/* void slab_push()
+ * Task: put a slab at the front of one of the lists of its cache
+ * Input : head----the list
+ *		   slab----the slab
+ * Output: None
+ */
+static void slab_push(slab_t** head, slab_t* slab){
+	slab->prev = NULL;
+	slab->next = *head;
+	if (*head != NULL){
+		(*head)->prev = slab;
+	}
+	*head = slab;
+}
+
+/* void slab_init()
+ * Task: make the kmalloc caches, the frame allocator must be seeded first
+ * Input : None
+ * Output: None
+ */
+void slab_init(void){
+	uint32_t i;
+
+	memset(caches, 0, sizeof(caches));
+	for (i=0;i<KMALLOC_CLASSES;i++){
+		kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], KMALLOC_MIN << i);
+	}
+	buffer_cache = kmalloc_caches[KMALLOC_CLASSES-1];
+}
+
+/* kmem_cache_t* kmem_cache_create()
+ * Task: make a cache of objects of one size, it takes no memory until the first allocation
+ * Input : name----shown in the statistics
+ *		   size----the size of an object, at most KMALLOC_MAX
+ * Output: the cache, NULL if the size is bad or there are MAX_CACHES already
+ */
+kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size){
+	kmem_cache_t* cache;
+	uint32_t align, i;
+
+	if (size == 0 || size > KMALLOC_MAX){
+		return NULL;
+	}
+	for (i=0;i<MAX_CACHES;i++){
+		if (!caches[i].used){
+			break;
+		}
+	}
+	if (i == MAX_CACHES){
+		return NULL;
+	}
+	cache = &caches[i];
+	memset(cache, 0, sizeof(kmem_cache_t));
+	cache->used = 1;
+	align = (size >= FRAME_SIZE) ? FRAME_SIZE : CACHE_LINE;
+	cache->first = (sizeof(slab_t) + align - 1) & ~(align - 1);
+	cache->stats.object_size = (size + align - 1) & ~(align - 1);
+	cache->stats.per_slab = (SLAB_SIZE - cache->first) / cache->stats.object_size;
+	strncpy(cache->stats.name, name, CACHE_NAME_LENGTH - 1);
+	return cache;
+}
+
+/* void* kmem_cache_alloc()
+ * Task: take an object, from a partly used slab first, then from the empty slab, then from a new slab
+ * Input : cache----the cache
+ * Output: the object, its content is undefined, NULL if no memory is left
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache){
+	slab_t* slab;
+	void* obj;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	slab = cache->partial;
+	if (slab == NULL){
+		slab = cache->empty;
+		if (slab != NULL){
+			slab_remove(&cache->empty, slab);
+		}
+		else{
+			slab = (slab_t*)frame_alloc(SLAB_ORDER, FRAME_KERNEL);
+			if (slab == NULL){
+				cache->stats.failures++;
+				restore_flags(flags);
+				return NULL;
+			}
+			slab->cache = cache;
+			slab->free = NULL;
+			slab->unused = 0;
+			slab->in_use = 0;
+			cache->stats.slabs++;
+		}
+		slab_push(&cache->partial, slab);
+	}
+	if (slab->free != NULL){
+		obj = slab->free;
+		slab->free = *(void**)obj;
+	}
+	else{
+		obj = (uint8_t*)slab + cache->first + slab->unused * cache->stats.object_size;
+		slab->unused++;
+	}
+	slab->in_use++;
+	if (slab->in_use == cache->stats.per_slab){
+		slab_remove(&cache->partial, slab);
+		slab_push(&cache->full, slab);
+	}
+	cache->stats.allocs++;
+	cache->stats.active++;
+	restore_flags(flags);
+	return obj;
+}
+
+/* void kmem_cache_free()
+ * Task: give an object back to its slab, a slab that becomes empty is kept if the cache
+ *		 has no empty slab, otherwise it goes back to the frame allocator
+ * Input : cache----the cache of the object
+ *		   obj------an object from kmem_cache_alloc, NULL or one of another cache is ignored
+ * Output: None
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj){
+	slab_t* slab = (slab_t*)((uint32_t)obj & ~(SLAB_SIZE - 1));
+	uint32_t flags;
+
+	if (obj == NULL || slab->cache != cache){
+		return;
+	}
+	cli_and_save(flags);
+	if (slab->in_use == cache->stats.per_slab){
+		slab_remove(&cache->full, slab);
+		slab_push(&cache->partial, slab);
+	}
+	*(void**)obj = slab->free;
+	slab->free = obj;
+	slab->in_use--;
+	if (slab->in_use == 0){
+		slab_remove(&cache->partial, slab);
+		if (cache->empty == NULL){
+			slab_push(&cache->empty, slab);
+		}
+		else{
+			slab->cache = NULL;
+			frame_free((uint32_t)slab);
+			cache->stats.slabs--;
+		}
+	}
+	cache->stats.frees++;
+	cache->stats.active--;
+	restore_flags(flags);
+}
+
+/* const kmem_stats_t* kmem_stats()
+ * Task: get the statistics of a cache
+ * Input : n----the index of the cache, from 0
+ * Output: the statistics, NULL if there is no cache n
+ */
+const kmem_stats_t* kmem_stats(uint32_t n){
+	if (n >= MAX_CACHES || !caches[n].used){
+		return NULL;
+	}
+	return &caches[n].stats;
+}
+
+/* void* kmalloc()
+ * Task: take memory from the smallest kmalloc cache that fits
+ * Input : size----the number of bytes, at most KMALLOC_MAX
+ * Output: the memory, aligned on CACHE_LINE and undefined, NULL if the size is bad or no memory is left
+ */
+void* kmalloc(uint32_t size){
+	uint32_t i;
+
+	if (size == 0 || size > KMALLOC_MAX){
+		return NULL;
+	}
+	for (i=0;(KMALLOC_MIN << i) < size;i++);
+	return kmem_cache_alloc(kmalloc_caches[i]);
+}
+
+/* void kfree()
+ * Task: give memory back to the cache it came from, found from its slab
+ * Input : obj----memory from kmalloc or kmem_cache_alloc, NULL is ignored
+ * Output: None
+ */
+void kfree(void* obj){
+	if (obj != NULL){
+		kmem_cache_free(((slab_t*)((uint32_t)obj & ~(SLAB_SIZE - 1)))->cache, obj);
+	}
+}
@@ -0,0 +1,63 @@
+/* slab.h - Defines for slab.c
+ *			used to allocate kernel objects smaller than a page
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "types.h"
+#include "page_alloc.h"
+
+#define SLAB_ORDER 3					// a slab is 2^3 frames from frame_alloc, aligned on its size
+#define SLAB_SIZE (FRAME_SIZE << SLAB_ORDER)
+#define CACHE_LINE 64					// objects are aligned on it, a page for objects of a page or more
+#define MAX_CACHES 16
+#define CACHE_NAME_LENGTH 16
+#define KMALLOC_MIN CACHE_LINE			// kmalloc rounds a size up to the next power of two from here
+#define KMALLOC_MAX 4096				// the largest kmalloc, the size of the buffer cache
+#define KMALLOC_CLASSES 7				// 64, 128, ... 4096
+
+/* new struct at the start of every slab */
+typedef struct slab{
+	struct kmem_cache* cache;
+	struct slab* prev;
+	struct slab* next;
+	void* free;						// first freed object, every free object holds the next one
+	uint32_t unused;				// objects from here to the end were never handed out
+	uint32_t in_use;
+} slab_t;
+
+/* new struct for what a cache did, kept by every cache */
+typedef struct kmem_stats{
+	int8_t name[CACHE_NAME_LENGTH];
+	uint32_t object_size;			// rounded up to the alignment
+	uint32_t per_slab;				// objects in one slab
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t active;				// objects in use
+	uint32_t slabs;					// slabs taken from frame_alloc and not given back
+	uint32_t failures;				// allocations that found no memory
+} kmem_stats_t;
+
+/* new struct for a cache of objects of one size, its slabs are on one of three lists */
+typedef struct kmem_cache{
+	uint32_t used;					// 1->created, 0->free entry
+	uint32_t first;					// offset of the first object in a slab
+	slab_t* partial;				// slabs with free and used objects, used first
+	slab_t* empty;					// at most one slab with no object in use, kept for the next allocation
+	slab_t* full;
+	kmem_stats_t stats;
+} kmem_cache_t;
+
+extern kmem_cache_t* buffer_cache;
+
+extern void slab_init(void);
+extern kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size);
+extern void* kmem_cache_alloc(kmem_cache_t* cache);
+extern void kmem_cache_free(kmem_cache_t* cache, void* obj);
+extern const kmem_stats_t* kmem_stats(uint32_t n);
+
+extern void* kmalloc(uint32_t size);
+extern void kfree(void* obj);
+
+#endif /* _SLAB_H */
@@ -14,6 +14,18 @@ extern int32_t getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t vidmap (uint8_t** screen_start);
 extern int32_t set_handler (int32_t signum, void* handler_address);
 extern int32_t sigreturn (void);
+extern int32_t getdents (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t mmap (int32_t fd);
+extern int32_t munmap (void* addr);
+extern int32_t create (const uint8_t* filename);
+extern int32_t truncate (int32_t fd, uint32_t length);
+extern int32_t stat (const uint8_t* filename, void* buf);
+extern int32_t fstat (int32_t fd, void* buf);
+extern int32_t lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t readv (int32_t fd, const void* iov, int32_t iovcnt);
+extern int32_t writev (int32_t fd, const void* iov, int32_t iovcnt);
+extern int32_t sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
 
 
 #endif
@@ -3,12 +3,30 @@
 #include "global.h"
 #include "terminal.h"
 #include "pit.h"
+#include "program_cache.h"
+#include "tmpfs.h"
+#include "page_alloc.h"
+#include "slab.h"
 
 //initialize the global variables
-uint8_t pid_array [MAX_PROCESSES] = {0,0,0,0,0,0};
+uint8_t pid_array [MAX_PROCESSES] = {0};
+/* memory of every process: the pcb and its fd table from their caches, the page directory
+ * and the kernel stack from the frame allocator, the user pages and their page tables are
+ * taken from it on first touch */
+static pcb_t* pcb_table[MAX_PROCESSES];
+static PD_t* directory_table[MAX_PROCESSES];
+static uint32_t kernel_block[MAX_PROCESSES];
+/* the kernel stack of the last base shell that halted, it is still in use until the new shell starts */
+static uint32_t halted_stack;
+static kmem_cache_t* pcb_cache;
+static kmem_cache_t* fd_table_cache;
+/* stands in for the pcb of a pid without a process */
+static pcb_t no_pcb;
+static file_desc_t no_fd_table[MAX_FILES];
 op_table_t rtc_table = {rtc_read, rtc_write, rtc_open, rtc_close};
 op_table_t dir_table = {dir_read, dir_write, dir_open, dir_close};
 op_table_t file_table = {file_read, file_write, file_open, file_close};
+op_table_t tmpfs_table = {tmpfs_read, tmpfs_write, tmpfs_open, tmpfs_close};
 op_table_t stdin_table = {terminal_read, no_write, no_open, no_close};
 op_table_t stdout_table = {no_read, terminal_write, no_open, no_close};
 
@@ -31,8 +49,9 @@ uint8_t cur_pid = 0;
 */
 int32_t execute_func(const uint8_t* command){
 	uint32_t entry_point;
-	int length_cmd;
+	int length_cmd, length_parsed;
 	int8_t parsed_command[MAX_PARSED];
+	int8_t bin_command[BIN_PREFIX_LENGTH+MAX_PARSED];
 	int8_t argument[MAX_ARG];
 	uint8_t buf[4]; // check for the executable
 	dentry_t execute_dentry;  //executable files
@@ -50,19 +69,21 @@ int32_t execute_func(const uint8_t* command){
 		if(command[i] == ' ' || command[i] == '\0'){
 			break;
 		}
-		if(i - start_point > MAX_PARSED-1){
+		/* keep room for the null */
+		if(i - start_point > MAX_PARSED-2){
 			sti();
 			return -1;
 		}
 		parsed_command[i-start_point] = command[i];
 	}
+	length_parsed = i - start_point;
 	/* set the start_point points to the second part of command */
 	start_point = i+1;
 	while (command[start_point]==' ') {
 		start_point++;
 	}
 	
-	for(;i < MAX_PARSED; i++) {
+	for(i = length_parsed; i < MAX_PARSED; i++) {
 		parsed_command [i] = '\0';
 	}
 	
@@ -78,10 +99,14 @@ int32_t execute_func(const uint8_t* command){
 	argument[end_point-start_point] = '\0';
 	
 
-	/* 2. executable check */
+	/* 2. executable check, a program not found by name may be on the image mounted at "bin/" */
 	if(0 != read_dentry_by_name((uint8_t*)parsed_command,&execute_dentry)){
-		sti();
-		return -1;
+		strcpy(bin_command, BIN_PREFIX);
+		strcpy(bin_command+BIN_PREFIX_LENGTH, parsed_command);
+		if(0 != read_dentry_by_name((uint8_t*)bin_command,&execute_dentry)){
+			sti();
+			return -1;
+		}
 	}
 
 	// try to read the first 4 bytes
@@ -94,6 +119,11 @@ int32_t execute_func(const uint8_t* command){
 		sti();
 		return -1; 
 	}
+	// the image has to leave a page of stack below USER_END
+	if(f_size > USER_END - four_KB - LOAD_START){
+		sti();
+		return -1;
+	}
 	// read in the 24-27 bytes in the executable file to the entry_point
 	read_data(execute_dentry.inode,(uint32_t)ENTRY_POINT_START, buf,4); //start from 24 in file
 	entry_point = *((uint32_t*)buf);
@@ -104,14 +134,23 @@ int32_t execute_func(const uint8_t* command){
 		sti();
 	    return -2;
 	}
+	if (alloc_process(new_pid) != 0){
+		pid_array[(uint8_t)new_pid] = 0;
+		printf("Not enough memory for a new process.\n");
+		sti();
+		return -2;
+	}
 	cur_pid = new_pid;
-	remap(_128MB , _8MB + new_pid * _4MB); //create new page to map virtual mem to physical mem (paging), and enable paging
-	/* 4. user-level program loader, read program image to virtual memory, as well as in physical memory */
-	i = read_data(execute_dentry.inode, 0, (uint8_t*)LOAD_START,f_size); //0x08048000, virtual memory
+	/* the user program has no pages yet, they are filled from the file system on first touch */
+	use_directory(new_pid);
+	/* 4. user-level program loader, record the program image, the page fault handler loads it */
 
 	/*5. create PCB */
 	pcb_t * new_pcb = get_specific_pcb(new_pid);
 	strcpy((int8_t*)new_pcb->arg,argument);
+	new_pcb->exe_inode = execute_dentry.inode;
+	new_pcb->exe_size = f_size;
+	new_pcb->exe_cache = program_cache_get(execute_dentry.inode, f_size);
 	
 	asm volatile(
 		"movl %%ebp, %%eax;"
@@ -124,7 +163,7 @@ int32_t execute_func(const uint8_t* command){
 	/* 6. context switch */
 	//most of the info in tss is unchanged, so we 
 	tss.ss0 = KERNEL_DS;
-    tss.esp0 = _8MB - _8KB * new_pid - 4; //the current process' stack base
+    tss.esp0 = kernel_block[(uint8_t)new_pid] + _8KB - 4; //the current process' stack base
 
 	term[curr_term].ss0 = tss.ss0;
 	term[curr_term].esp0 = tss.esp0;
@@ -144,7 +183,7 @@ int32_t execute_func(const uint8_t* command){
     	"mov %%ax, %%ds;"
     	"pushl $0x2B;"
     	// ESP
-    	"movl $0x83FFFFC, %%eax;" // 0x83FFFFC = 128MB + 4MB - 4, everytime we remap, the virtual memory location keeps the same
+    	"movl %1, %%eax;" // USER_STACK, the top of the user program region, the same in every process
     	"pushl %%eax;"
     	// EFLAG
     	"pushfl;"
@@ -160,7 +199,7 @@ int32_t execute_func(const uint8_t* command){
     	"leave;"
     	"ret;"
     	: // no outputs
-    	:"r"(entry_point) // input
+    	:"r"(entry_point), "i"(USER_STACK) // input
     	:"%edx","%eax" 
     );
     return 0;
@@ -176,6 +215,7 @@ int32_t execute_func(const uint8_t* command){
 */
 int32_t halt_func(uint8_t status) { //halt term[curr_term].running_pid
 	int i;
+	uint32_t esp, ebp;
 	cli();
 	pcb_t* cur_pcb;
 	if(status == 1) //halt from ctrl+C
@@ -216,7 +256,26 @@ int32_t halt_func(uint8_t status) { //halt term[curr_term].running_pid
 		if(cur_pcb -> fd_table[i].flags == 1)
 			close(i);
 	}
-	if(cur_pcb-> parent == NULL) { //this terminal(curr_term in display)
+	/* drop the mapped files, their page table goes with the process */
+	memset(cur_pcb -> mmaps, 0, sizeof(cur_pcb -> mmaps));
+	program_cache_put(cur_pcb -> exe_cache);
+	cur_pcb -> exe_cache = -1;
+	/* the pcb is freed below, the fields still needed are copied out first */
+	esp = cur_pcb -> esp;
+	ebp = cur_pcb -> ebp;
+	/* a base shell that halted earlier left its stack behind, its new shell runs on its own */
+	frame_free(halted_stack);
+	halted_stack = 0;
+	/* this code runs on the kernel stack of the halting process, a freed block isn't written, but
+	 * execute("shell") below allocates and could be handed the stack, so a base shell keeps it */
+	if(parent_pcb == NULL) {
+		halted_stack = kernel_block[cur_pcb -> pid];
+		kernel_block[cur_pcb -> pid] = 0;
+	}
+	/* the directory of the halting process may be the loaded one */
+	load_directory(NULL);
+	free_process(cur_pcb -> pid);
+	if(parent_pcb == NULL) { //this terminal(curr_term in display)
 		term[halt_term].running_pid = -1;
 		execute((uint8_t*)"shell");
 	} 
@@ -225,8 +284,8 @@ int32_t halt_func(uint8_t status) { //halt term[curr_term].running_pid
 	term[halt_term].running_pid = parent_pcb->pid;
 
 	// restore paging
-	remap(_128MB , _8MB + parent_pcb->pid * _4MB);
-	tss.esp0 = (uint32_t)cur_pcb->esp;
+	use_directory(parent_pcb->pid);
+	tss.esp0 = esp;
 	cur_pid = parent_pcb->pid;
 
 	sti();
@@ -238,7 +297,7 @@ int32_t halt_func(uint8_t status) { //halt term[curr_term].running_pid
 		"mov %2, %%ebp;"
 		"jmp RET_FROM_IRET;"
 		: // no output
-		:"r"((uint32_t)status), "r"(cur_pcb->esp),"r"(cur_pcb->ebp) 
+		:"r"((uint32_t)status), "r"(esp),"r"(ebp) 
 		:"%eax"
 		);
 	return 0;
@@ -284,6 +343,7 @@ void init_pcb(pcb_t * pcb, uint8_t pid){ //new_pcb, new_pid
 		pcb->pid = pid;
 	}
 	pcb->term_id = curr_term;
+	memset(pcb->mmaps, 0, sizeof(pcb->mmaps));
 	pcb->fd_table[0].op_table_ptr = stdin_table;
 	pcb->fd_table[1].op_table_ptr = stdout_table;
 	pcb->fd_table[0].flags = 1;
@@ -297,9 +357,119 @@ void init_pcb(pcb_t * pcb, uint8_t pid){ //new_pcb, new_pid
 *   Output: return the pointer to the pcb
  */
 pcb_t* get_specific_pcb(uint8_t pid){
-	uint32_t addr;
-	addr = _8MB - _8KB * (1+pid);
-	return (pcb_t*)addr;
+	if (pid >= MAX_PROCESSES || pcb_table[pid] == NULL){
+		return &no_pcb;
+	}
+	return pcb_table[pid];
+}
+
+/* 
+*	Function process_init ()
+*	Description: make the caches of pcbs and fd tables, after slab_init
+*   Input:  none
+*   Output: none
+ */
+void process_init(void){
+	pcb_cache = kmem_cache_create("pcb", sizeof(pcb_t));
+	fd_table_cache = kmem_cache_create("fd_table", sizeof(file_desc_t) * MAX_FILES);
+	no_pcb.fd_table = no_fd_table;
+}
+
+/* 
+*	Function alloc_process (uint8_t pid)
+*	Description: take the memory of a new process, the pcb and its fd table are cleared
+*   Input:  pid---the index of the process
+*   Output: return 0 on success, -1 if there is not enough memory
+ */
+int32_t alloc_process(uint8_t pid){
+	/* the pcb is cleared first, free_process on a failure below must see a NULL fd table */
+	pcb_table[pid] = kmem_cache_alloc(pcb_cache);
+	if (pcb_table[pid] != NULL){
+		memset(pcb_table[pid], 0, sizeof(pcb_t));
+	}
+	directory_table[pid] = new_directory();
+	kernel_block[pid] = frame_alloc(KERNEL_BLOCK_ORDER, FRAME_KERNEL);
+	if (pcb_table[pid] == NULL || directory_table[pid] == NULL || kernel_block[pid] == 0){
+		free_process(pid);
+		return -1;
+	}
+	pcb_table[pid]->fd_table = kmem_cache_alloc(fd_table_cache);
+	if (pcb_table[pid]->fd_table == NULL){
+		free_process(pid);
+		return -1;
+	}
+	memset(pcb_table[pid]->fd_table, 0, sizeof(file_desc_t) * MAX_FILES);
+	return 0;
+}
+
+/* 
+*	Function mmap_table (uint8_t pid, uint32_t create)
+*	Description: find the page table of the mmap window of a process, it is taken from the
+*				 frame allocator on the first mmap
+*   Input:  pid------the index of the process
+*			create---1 to take the table if the process has none yet
+*   Output: the table, NULL if there is none or no memory is left for it
+ */
+static PT_t* mmap_table(uint8_t pid, uint32_t create){
+	PD_t* directory = directory_table[pid];
+	PT_t* table;
+	
+	if (!directory->page_directory[MMAP_ADDR/_4MB].kb.p){
+		if (!create || (table = alloc_page()) == NULL){
+			return NULL;
+		}
+		memset(table, 0, sizeof(PT_t));
+		remap_table(directory, MMAP_ADDR, table);
+	}
+	return (PT_t*)(directory->page_directory[MMAP_ADDR/_4MB].kb.page_table_base_addr << shift);
+}
+
+/* 
+*	Function free_process (uint8_t pid)
+*	Description: give the memory of a process back to its caches and the frame allocator
+*   Input:  pid---the index of the process
+*   Output: none
+ */
+void free_process(uint8_t pid){
+	if (pcb_table[pid] != NULL){
+		kmem_cache_free(fd_table_cache, pcb_table[pid]->fd_table);
+		kmem_cache_free(pcb_cache, pcb_table[pid]);
+	}
+	if (directory_table[pid] != NULL){
+		free_user_pages(directory_table[pid]);
+		free_page(mmap_table(pid, 0));
+		free_directory(directory_table[pid]);
+	}
+	frame_free(kernel_block[pid]);
+	pcb_table[pid] = NULL;
+	directory_table[pid] = NULL;
+	kernel_block[pid] = 0;
+}
+
+/* 
+*	Function free_user_pages (PD_t* directory)
+*	Description: give back the frames of the user program and the page tables holding them,
+*				 shared pages of the program cache stay with the cache
+*   Input:  directory---the page directory of the process
+*   Output: none
+ */
+void free_user_pages(PD_t* directory){
+	uint32_t pde, i;
+	PT_t* table;
+	
+	for (pde=_128MB/_4MB;pde<USER_END/_4MB;pde++){
+		if (!directory->page_directory[pde].kb.p){
+			continue;
+		}
+		table = (PT_t*)(directory->page_directory[pde].kb.page_table_base_addr << shift);
+		for (i=0;i<NUMBER_ENTRIES;i++){
+			if (table->page_table[i].p && !(table->page_table[i].avail & PTE_COW)){
+				frame_free(table->page_table[i].page_base_addr << shift);
+			}
+		}
+		free_page(table);
+		directory->page_directory[pde].kb.pointer = 0;
+	}
 }
 
 /* 
@@ -373,6 +543,7 @@ int32_t open_func(const uint8_t* filename){
 	pcb_t* pcb = get_specific_pcb(cur_pid); 
 	dentry_t file_dentry;
 	uint32_t fd,file_type;
+	int32_t node = -1;
 	
 	/*check filename */ 
 	if(filename == NULL){
@@ -393,8 +564,13 @@ int32_t open_func(const uint8_t* filename){
 		return 0;
 	}
 	
-	/* read by name */
-	if (read_dentry_by_name(filename,&file_dentry) == -1){
+	/* a tmpfs file, otherwise read by name */
+	if (tmpfs_name(filename) != NULL){
+		if ((node = tmpfs_lookup(tmpfs_name(filename))) < 0){
+			return -1;
+		}
+	}
+	else if (read_dentry_by_name(filename,&file_dentry) == -1){
 		return -1;		// read by name fails
 	}
 	
@@ -403,6 +579,8 @@ int32_t open_func(const uint8_t* filename){
 		if (pcb->fd_table[fd].flags==0){
 			pcb->fd_table[fd].flags = 1;
 			pcb->fd_table[fd].file_position = 0;
+			pcb->fd_table[fd].ra_next = 0;
+			pcb->fd_table[fd].ra_window = 0;
 			break;
 		}
 	}
@@ -412,6 +590,12 @@ int32_t open_func(const uint8_t* filename){
 		return -1;
 	}
 	
+	if (node >= 0){
+		pcb->fd_table[fd].inode = node;					// initialize
+		pcb->fd_table[fd].op_table_ptr = tmpfs_table;
+		return fd;
+	}
+	
 	/* check the file type */
 	file_type = file_dentry.file_type;
 	if (file_type==0){			// rtc
@@ -422,7 +606,7 @@ int32_t open_func(const uint8_t* filename){
 		pcb->fd_table[fd].op_table_ptr = rtc_table;
 	}
 	else if (file_type==1){		// dir
-		pcb->fd_table[fd].inode = 0;					// initialize
+		pcb->fd_table[fd].inode = file_dentry.inode;	// initialize, names the image the directory is on
 		pcb->fd_table[fd].op_table_ptr = dir_table;
 	}
 	else if (file_type==2){		// file
@@ -542,13 +726,559 @@ int32_t vidmap_func(uint8_t ** screen_start){
 		return -1;
 	}
 	
-	/* map the memory */
-	*screen_start = (uint8_t*)_132MB;// not sure, decide by ourselves
+	/* map the memory, the vidmap page of the terminal follows whether the terminal is shown */
+	*screen_start = (uint8_t*)VIDMAP_ADDR;// not sure, decide by ourselves
 
-	remap_vid(_132MB, VIDEO); //0xB8000
+	remap_table(directory_table[cur_pid], VIDMAP_ADDR, vid_table(get_specific_pcb(cur_pid)->term_id));
 
 	return 0;
 }
+/* int32_t getdents_func(): read many directory entries in one system call
+ * Input:  fd-----the index of the file_descriptor, must be an open directory
+ *		   buf----the buffer to fill with dirent_t records
+ *		   nbytes-the size of buf
+ * Output: return the number of bytes filled, 0 at the end of the directory, -1 on failure
+ */
+int32_t getdents_func(int32_t fd, void * buf, int32_t nbytes){
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1 || buf==NULL){
+		return -1;
+	}
+	
+	/* get the current pcb */
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	/* only an open directory has entries */
+	if (pcb->fd_table[fd].flags == 0 || pcb->fd_table[fd].op_table_ptr.read != dir_read){
+		return -1;
+	}
+	
+	return dir_getdents(fd,buf,nbytes);
+}
+
+/* int32_t create_func(): make an empty file, an existing file is truncated to 0,
+ *						  names starting with "tmp/" are made on the tmpfs
+ * Input:  filename---the name of the file
+ * Output: if success return 0, otherwise return -1
+ */
+int32_t create_func(const uint8_t* filename){
+	if (filename == NULL){
+		return -1;
+	}
+	if (tmpfs_name(filename) != NULL){
+		return (tmpfs_create(tmpfs_name(filename)) < 0) ? -1 : 0;
+	}
+	return create_file(filename);
+}
+
+/* int32_t truncate_func(): cut an open file down to a length
+ * Input:  fd-------the index of the file_descriptor, must be an open regular or tmpfs file
+ *		   length---the new length, at most the current one
+ * Output: if success return 0, otherwise return -1
+ */
+int32_t truncate_func(int32_t fd, uint32_t length){
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1){
+		return -1;
+	}
+	
+	/* get the current pcb */
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	if (pcb->fd_table[fd].flags == 0){
+		return -1;
+	}
+	if (pcb->fd_table[fd].op_table_ptr.read == tmpfs_read){
+		if (tmpfs_truncate(pcb->fd_table[fd].inode, length) != 0){
+			return -1;
+		}
+	}
+	else if (pcb->fd_table[fd].op_table_ptr.read != file_read || truncate_data(pcb->fd_table[fd].inode, length) != 0){
+		return -1;
+	}
+	if (pcb->fd_table[fd].file_position > length){
+		pcb->fd_table[fd].file_position = length;
+	}
+	return 0;
+}
+
+/* int32_t stat_func(): get the type, length and inode of a file without opening it
+ * Input:  filename---the name of the file, on the tmpfs or on a mounted image
+ *		   buf--------filled with one stat_t
+ * Output: if success return 0, otherwise return -1
+ */
+int32_t stat_func(const uint8_t* filename, void* buf){
+	stat_t* st = (stat_t*)buf;
+	dentry_t file_dentry;
+	int32_t node;
+	
+	if (filename == NULL || buf == NULL){
+		return -1;
+	}
+	if (tmpfs_name(filename) != NULL){
+		if ((node = tmpfs_lookup(tmpfs_name(filename))) < 0){
+			return -1;
+		}
+		st->inode = node;
+		st->file_type = 2;
+		st->size = tmpfs_length(node);
+		return 0;
+	}
+	if (read_dentry_by_name(filename, &file_dentry) != 0){
+		return -1;
+	}
+	st->inode = file_dentry.inode;
+	st->file_type = file_dentry.file_type;
+	st->size = (file_dentry.file_type == 2) ? file_length(file_dentry.inode) : 0;
+	return 0;
+}
+
+/* int32_t fstat_func(): get the type, length and inode of an open file
+ * Input:  fd-----the index of the file_descriptor, the terminal has no stat
+ *		   buf----filled with one stat_t
+ * Output: if success return 0, otherwise return -1
+ */
+int32_t fstat_func(int32_t fd, void* buf){
+	stat_t* st = (stat_t*)buf;
+	file_desc_t* file;
+	
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1 || buf==NULL){
+		return -1;
+	}
+	file = &get_specific_pcb(cur_pid)->fd_table[fd];
+	if (file->flags == 0){
+		return -1;
+	}
+	
+	st->inode = file->inode;
+	st->size = 0;
+	if (file->op_table_ptr.read == file_read){
+		st->file_type = 2;
+		st->size = file_length(file->inode);
+	}
+	else if (file->op_table_ptr.read == tmpfs_read){
+		st->file_type = 2;
+		st->size = tmpfs_length(file->inode);
+	}
+	else if (file->op_table_ptr.read == dir_read){
+		st->file_type = 1;
+	}
+	else if (file->op_table_ptr.read == rtc_read){
+		st->file_type = 0;
+	}
+	else{
+		return -1;
+	}
+	return 0;
+}
+
+/* int32_t lseek_func(): move the file position of an open file
+ * Input:  fd-------the index of the file_descriptor, a regular file, a tmpfs file or a directory
+ *		   offset---the new position, relative to whence
+ *		   whence---SEEK_SET, SEEK_CUR or SEEK_END (not for a directory, its position is an entry index)
+ * Output: if success return the new position, otherwise return -1
+ */
+int32_t lseek_func(int32_t fd, int32_t offset, int32_t whence){
+	file_desc_t* file;
+	int32_t base;
+	
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1){
+		return -1;
+	}
+	file = &get_specific_pcb(cur_pid)->fd_table[fd];
+	if (file->flags == 0){
+		return -1;
+	}
+	
+	if (file->op_table_ptr.read != file_read && file->op_table_ptr.read != tmpfs_read && file->op_table_ptr.read != dir_read){
+		return -1;
+	}
+	if (whence == SEEK_SET){
+		base = 0;
+	}
+	else if (whence == SEEK_CUR){
+		base = file->file_position;
+	}
+	else if (whence == SEEK_END && file->op_table_ptr.read == file_read){
+		base = file_length(file->inode);
+	}
+	else if (whence == SEEK_END && file->op_table_ptr.read == tmpfs_read){
+		base = tmpfs_length(file->inode);
+	}
+	else{
+		return -1;
+	}
+	/* a position past the end is fine, reads there return 0 and writes grow the file */
+	if (base+offset < 0){
+		return -1;
+	}
+	file->file_position = base+offset;
+	return file->file_position;
+}
+
+/* int32_t pread_func(): read at a given position, the file position doesn't move
+ * Input:  fd-------the index of the file_descriptor, a regular or tmpfs file
+ *		   buf------the buffer to fill
+ *		   nbytes---the number of bytes to read
+ *		   offset---where to read in the file
+ * Output: return the number of bytes read, 0 past the end of the file, -1 on failure
+ */
+int32_t pread_func(int32_t fd, void* buf, int32_t nbytes, uint32_t offset){
+	file_desc_t* file;
+	uint32_t position;
+	int32_t count;
+	
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1 || buf==NULL){
+		return -1;
+	}
+	file = &get_specific_pcb(cur_pid)->fd_table[fd];
+	if (file->flags == 0 || (file->op_table_ptr.read != file_read && file->op_table_ptr.read != tmpfs_read)){
+		return -1;
+	}
+	/* the fd table is private to the process, so the position can be borrowed */
+	position = file->file_position;
+	file->file_position = offset;
+	count = file->op_table_ptr.read(fd,buf,nbytes);
+	file->file_position = position;
+	return count;
+}
+
+/* int32_t readv_func(): read into several buffers in one system call, each one is filled before the next
+ * Input:  fd-------the index of the file_descriptor
+ *		   iov------the buffers
+ *		   iovcnt---the number of buffers, at most IOV_MAX
+ * Output: return the number of bytes read, it stops at the first short read, -1 if nothing could be read
+ */
+int32_t readv_func(int32_t fd, const iovec_t* iov, int32_t iovcnt){
+	int32_t i, count, total = 0;
+	
+	if (iov == NULL || iovcnt < 0 || iovcnt > IOV_MAX){
+		return -1;
+	}
+	for (i=0;i<iovcnt;i++){
+		count = read_func(fd, iov[i].base, iov[i].length);
+		if (count < 0){
+			return (total > 0) ? total : -1;
+		}
+		total += count;
+		if (count < iov[i].length){
+			break;
+		}
+	}
+	return total;
+}
+
+/* int32_t writev_func(): write several buffers in one system call, in order
+ * Input:  fd-------the index of the file_descriptor
+ *		   iov------the buffers
+ *		   iovcnt---the number of buffers, at most IOV_MAX
+ * Output: return the number of bytes written, it stops at the first short write, -1 if nothing could be written
+ */
+int32_t writev_func(int32_t fd, const iovec_t* iov, int32_t iovcnt){
+	int32_t i, count, total = 0;
+	
+	if (iov == NULL || iovcnt < 0 || iovcnt > IOV_MAX){
+		return -1;
+	}
+	for (i=0;i<iovcnt;i++){
+		count = write_func(fd, iov[i].base, iov[i].length);
+		if (count < 0){
+			return (total > 0) ? total : -1;
+		}
+		total += count;
+		if (count < iov[i].length){
+			break;
+		}
+	}
+	return total;
+}
+
+/* int32_t sendfile_func(): copy from a file to another fd inside the kernel, from the file position on
+ *							 a file of a memory-resident image is written straight from its data blocks,
+ *							 other files go through one page from the page pool
+ * Input:  out_fd---the index of the file_descriptor to write to, any writable fd
+ *		   in_fd----the index of the file_descriptor to read from, a regular or tmpfs file
+ *		   count----the number of bytes to copy
+ * Output: return the number of bytes copied, 0 at the end of the file, -1 on failure
+ */
+int32_t sendfile_func(int32_t out_fd, int32_t in_fd, int32_t count){
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	file_desc_t* in;
+	uint8_t* page = NULL;
+	uint8_t* data;
+	uint32_t length, line;
+	int32_t span, written, total = 0;
+	
+	/* check the non-valid inputs */
+	if (in_fd<0 || in_fd>MAX_FILES-1 || out_fd<0 || out_fd>MAX_FILES-1 || count<0){
+		return -1;
+	}
+	in = &pcb->fd_table[in_fd];
+	if (in->flags == 0 || pcb->fd_table[out_fd].flags == 0
+		|| (in->op_table_ptr.read != file_read && in->op_table_ptr.read != tmpfs_read)){
+		return -1;
+	}
+	
+	/* one block at a time, never across the end of a data block */
+	while (total < count){
+		line = in->file_position % four_KB;
+		span = four_KB - line;
+		if (span > count-total){
+			span = count-total;
+		}
+		data = NULL;
+		if (in->op_table_ptr.read == file_read){
+			length = file_length(in->inode);
+			if (in->file_position >= length){
+				break;
+			}
+			if (span > length - in->file_position){
+				span = length - in->file_position;
+			}
+			data = file_block_addr(in->inode, in->file_position / four_KB);
+			if (data != NULL){
+				data += line;
+			}
+		}
+		if (data == NULL){
+			if (page == NULL && (page = alloc_page()) == NULL){
+				break;
+			}
+			span = in->op_table_ptr.read(in_fd, page, span);
+			if (span <= 0){
+				break;
+			}
+			in->file_position -= span;		/* moved below by what was written */
+			data = page;
+		}
+		written = write_func(out_fd, data, span);
+		if (written <= 0){
+			if (total == 0){
+				total = -1;
+			}
+			break;
+		}
+		in->file_position += written;
+		total += written;
+		if (written < span){
+			break;
+		}
+	}
+	
+	if (page != NULL){
+		free_page(page);
+	}
+	return total;
+}
+
+/* void use_directory(): switch to the address space of a process, one cr3 load
+ * Input:  pid----the process to switch to, the kernel directory is used for a pid without a process
+ * Output: none
+ */
+void use_directory(uint8_t pid){
+	load_directory((pid < MAX_PROCESSES) ? directory_table[pid] : NULL);
+}
+
+/* PTE_t* user_pte(): find the page table entry of a page of the user program,
+ *					   the page table of its 4MB region is taken from the frame allocator on first use
+ * Input:  page----the user address of the page
+ * Output: the entry, NULL if there is no memory for the page table
+ */
+static PTE_t* user_pte(uint32_t page){
+	PD_t* directory = directory_table[cur_pid];
+	uint32_t pde = page / _4MB;
+	PT_t* table;
+	
+	if (!directory->page_directory[pde].kb.p){
+		table = alloc_page();
+		if (table == NULL){
+			return NULL;
+		}
+		memset(table, 0, sizeof(PT_t));
+		remap_table(directory, pde*_4MB, table);
+	}
+	table = (PT_t*)(directory->page_directory[pde].kb.page_table_base_addr << shift);
+	return &table->page_table[(page % _4MB) / four_KB];
+}
+
+/* int32_t load_user_page(): load one page of the user program on first touch into a 4KB frame of its own,
+ *							 unless it maps a shared page of the program cache until it is written
+ * Input:  fault_addr----the address that caused the page fault
+ *		   error_code----the error code of the page fault
+ * Output: 0 if the page is loaded, -1 if the fault is not a missing or shared user page or no memory is left
+ */
+int32_t load_user_page(uint32_t fault_addr, uint32_t error_code){
+	uint32_t page, offset, length, frame;
+	uint8_t* buffer;
+	PTE_t* pte;
+	pcb_t* pcb;
+	
+	if (fault_addr < _128MB || fault_addr >= USER_END){
+		return -1;
+	}
+	page = fault_addr & ~(four_KB-1);
+	pte = user_pte(page);
+	pcb = get_specific_pcb(cur_pid);
+	if (pte == NULL){
+		return -1;
+	}
+	
+	if (error_code & PF_PRESENT){
+		/* only the first write to a shared page is expected */
+		if (!(error_code & PF_WRITE) || !(pte->avail & PTE_COW)){
+			return -1;
+		}
+		/* the shared page is copied through a buffer when it is first written */
+		buffer = kmem_cache_alloc(buffer_cache);
+		frame = frame_alloc(0, 0);
+		if (buffer == NULL || frame == 0){
+			kmem_cache_free(buffer_cache, buffer);
+			frame_free(frame);
+			return -1;
+		}
+		memcpy(buffer, (void*)page, four_KB);
+		pte->rw = 1;
+		pte->avail = 0;
+		pte->page_base_addr = frame >> shift;
+		flush_page(page);
+		memcpy((void*)page, buffer, four_KB);
+		kmem_cache_free(buffer_cache, buffer);
+		pcb->resident++;
+		return 0;
+	}
+	
+	/* pages of the image come from the program cache, read-only until written */
+	if (pcb->exe_cache >= 0 && page >= LOAD_START && page < LOAD_START + pcb->exe_size){
+		frame = program_cache_page(pcb->exe_cache, (page - LOAD_START) / four_KB);
+		if (frame != 0){
+			pte->pointer = 0;
+			pte->p = 1;			/* set present */
+			pte->rw = 0;		/* read only, copied on the first write */
+			pte->us = 1;		/* assign the user privilege level */
+			pte->avail = PTE_COW;
+			pte->page_base_addr = frame >> shift;
+			return 0;
+		}
+	}
+	
+	/* the frame may be above the memory the kernel maps, it is filled through the user address */
+	frame = frame_alloc(0, 0);
+	if (frame == 0){
+		return -1;
+	}
+	pte->pointer = 0;
+	pte->p = 1;			/* set present */
+	pte->rw = 1;		/* read and write */
+	pte->us = 1;		/* assign the user privilege level */
+	pte->page_base_addr = frame >> shift;
+	pcb->resident++;
+	
+	/* fill the page with the part of the image it covers, the rest is zero */
+	memset((void*)page, 0, four_KB);
+	if (page + four_KB > LOAD_START && page < LOAD_START + pcb->exe_size){
+		offset = (page > LOAD_START) ? page - LOAD_START : 0;
+		length = pcb->exe_size - offset;
+		if (length > four_KB){
+			length = four_KB;
+		}
+		read_data(pcb->exe_inode, offset, (uint8_t*)(LOAD_START + offset), length);
+	}
+	return 0;
+}
+
+/* int32_t mmap_func(): map the data blocks of a file read-only into the mmap window,
+ *						the pages point straight into the file system image, nothing is copied,
+ *						so a writable image, whose blocks can be freed, is never mapped
+ * Input:  fd-----the index of the file_descriptor, must be an open regular file
+ * Output: if success return the user address of the first byte of the file, otherwise return -1
+ */
+int32_t mmap_func(int32_t fd){
+	uint32_t pages, start, run, slot, k;
+	uint8_t* addr;
+	PT_t* table;
+	
+	/* check the non-valid inputs */
+	if (fd<0 || fd>MAX_FILES-1){
+		return -1;
+	}
+	
+	/* get the current pcb */
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	/* only regular files can be mapped */
+	if (pcb->fd_table[fd].flags == 0 || pcb->fd_table[fd].op_table_ptr.read != file_read){
+		return -1;
+	}
+	pages = (file_length(pcb->fd_table[fd].inode)+four_KB-1)/four_KB;
+	if (pages == 0){
+		return -1;
+	}
+	
+	/* find a free mapping slot */
+	for (slot=0;slot<MAX_MMAPS;slot++){
+		if (pcb->mmaps[slot].count == 0){
+			break;
+		}
+	}
+	if (slot == MAX_MMAPS){
+		return -1;
+	}
+	
+	/* find the first run of free pages in the window that is long enough */
+	table = mmap_table(cur_pid, 1);
+	if (table == NULL){
+		return -1;
+	}
+	run = 0;
+	for (start=0;start<NUMBER_ENTRIES && run<pages;start++){
+		run = table->page_table[start].p ? 0 : run+1;
+	}
+	if (run < pages){
+		return -1;		/* the window is full */
+	}
+	start -= pages;
+	
+	/* map every data block as a read-only user page */
+	for (k=0;k<pages;k++){
+		addr = file_block_addr(pcb->fd_table[fd].inode, k);
+		if (addr == NULL || ((uint32_t)addr & (four_KB-1)) != 0){
+			/* undo the pages mapped so far */
+			memset(&table->page_table[start], 0, k*sizeof(PTE_t));
+			return -1;
+		}
+		table->page_table[start+k].pointer = 0;
+		table->page_table[start+k].p = 1;			/* set present */
+		table->page_table[start+k].rw = 0;			/* read only */
+		table->page_table[start+k].us = 1;			/* assign the user privilege level */
+		table->page_table[start+k].page_base_addr = (uint32_t)addr >> shift;
+	}
+	/* the pages weren't present, so the TLB has nothing to drop */
+	
+	pcb->mmaps[slot].start = start;
+	pcb->mmaps[slot].count = pages;
+	return MMAP_ADDR + start*four_KB;
+}
+
+/* int32_t munmap_func(): remove a mapping made by mmap
+ * Input:  addr---the address returned by mmap
+ * Output: if success return 0, otherwise return -1
+ */
+int32_t munmap_func(void * addr){
+	uint32_t slot;
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	PT_t* table = mmap_table(cur_pid, 0);
+	
+	for (slot=0;slot<MAX_MMAPS;slot++){
+		if (table != NULL && pcb->mmaps[slot].count != 0 && MMAP_ADDR + pcb->mmaps[slot].start*four_KB == (uint32_t)addr){
+			memset(&table->page_table[pcb->mmaps[slot].start], 0, pcb->mmaps[slot].count*sizeof(PTE_t));
+			flush_range((uint32_t)addr, pcb->mmaps[slot].count);
+			pcb->mmaps[slot].count = 0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
 int32_t set_handler_func(int32_t signum, void * handler_address){
 	return 0;
 }
@@ -7,16 +7,25 @@
 #include "lib.h"
 
 #define MAX_FILES 8
-#define MAX_PROCESSES 6
-#define MAX_PARSED 10
+#define MAX_PROCESSES 64
+#define MAX_PARSED 48		// a mount prefix and a 32 char name, with the null
+#define BIN_PREFIX "bin/"	// where execute looks for a program it doesn't find by name
+#define BIN_PREFIX_LENGTH 4
 
 #define LAST_TWO_B_USER_CS 0x23
 #define LAST_TWO_B_USER_DS 0x2B
 #define _8MB 0x800000
 #define _4MB 0x400000
 #define _8KB 0x8000
+#define KERNEL_BLOCK_ORDER 3	// frame order of the _8KB kernel stack of a process
+#define PF_PRESENT 0x1		// page fault error code: the page was present
+#define PF_WRITE 0x2		// page fault error code: the access was a write
+#define PTE_COW 0x1			// avail bit of a user page table entry: shared page, copy on write
 #define _128MB 0x8000000 
-#define _132MB 0x8400000
+#define USER_PDES 16		// 4MB regions of the user program from _128MB, image, data and stack
+#define USER_END (_128MB + USER_PDES*_4MB)		// 192MB, VIDMAP_ADDR in paging.h
+#define USER_STACK (USER_END - 4)
+#define MMAP_ADDR (VIDMAP_ADDR + _4MB)			// the mmap window, after the vidmap page
 #define KERNEL_CS 0x0010
 #define KERNEL_DS 0x0018
 #define ENTRY_POINT_START 24
@@ -26,6 +35,11 @@
 #define thirdB_in_file   0x4c
 #define fourthB_in_file 0x46
 #define MAX_ARG 1024
+#define MAX_MMAPS 8
+#define SEEK_SET 0			// lseek: from the start of the file
+#define SEEK_CUR 1			// lseek: from the file position
+#define SEEK_END 2			// lseek: from the end of the file
+#define IOV_MAX 16			// buffers in one readv or writev
 
 /* new struct to store the operation table for fd */
 typedef struct op_table{
@@ -41,11 +55,25 @@ typedef struct file_desc{
 	uint32_t inode;
 	uint32_t file_position;
 	uint32_t flags;		// 1->in use,0->not in use
+	uint32_t ra_next;	// offset a sequential read would start at
+	uint32_t ra_window;	// blocks read ahead, 0 while the file isn't read sequentially
 } file_desc_t;
 
+/* new struct to store one file mapped by mmap */
+typedef struct mmap_region{
+	uint32_t start;		// first page table entry of the mapping in the mmap window
+	uint32_t count;		// number of 4KB pages, 0->slot not in use
+} mmap_region_t;
+
+/* new struct for one buffer of readv and writev */
+typedef struct iovec{
+	void* base;
+	int32_t length;
+} iovec_t;
+
 /* new struct to store every pcb */
 typedef struct pcb{
-	file_desc_t fd_table[MAX_FILES];	// file descriptor array
+	file_desc_t* fd_table;		// file descriptor array of MAX_FILES, from fd_table_cache
 	uint8_t pid;				// unique identifier for the process: One bit of per-task state that needs to be saved is the file array
 	//parent_pid = pid - 1
 	struct pcb * parent;
@@ -57,6 +85,11 @@ typedef struct pcb{
 	int8_t arg[MAX_ARG];
 	uint16_t ss0;
 	uint32_t esp0;
+	mmap_region_t mmaps[MAX_MMAPS];	// files mapped into the mmap window at MMAP_ADDR
+	uint32_t exe_inode;			// inode of the program, its pages are loaded on first touch
+	uint32_t exe_size;			// length of the program image
+	int32_t exe_cache;			// slot of the program in the program cache, -1 if loaded privately
+	uint32_t resident;			// 4KB frames of its own the user program has touched, not counting shared ones
 
 } pcb_t;
 
@@ -68,6 +101,12 @@ void init_pcb(pcb_t * pcb, uint8_t pid);
 int8_t get_available_pid(); //by cyf
 pcb_t* get_parent_pcb(uint8_t pid);
 pcb_t* get_specific_pcb(uint8_t pid);
+void process_init(void);
+int32_t alloc_process(uint8_t pid);
+void free_process(uint8_t pid);
+void free_user_pages(PD_t* directory);
+void use_directory(uint8_t pid);
+int32_t load_user_page(uint32_t fault_addr, uint32_t error_code);
 
 
 //global variables
@@ -84,6 +123,18 @@ extern int32_t getargs_func(uint8_t * buf, int32_t nbytes);
 extern int32_t vidmap_func(uint8_t ** screen_start);
 extern int32_t set_handler_func(int32_t signum, void * handler_address);
 extern int32_t sigreturn_func(void);
+extern int32_t getdents_func(int32_t fd, void * buf, int32_t nbytes);
+extern int32_t mmap_func(int32_t fd);
+extern int32_t create_func(const uint8_t* filename);
+extern int32_t truncate_func(int32_t fd, uint32_t length);
+extern int32_t munmap_func(void * addr);
+extern int32_t stat_func(const uint8_t* filename, void* buf);
+extern int32_t fstat_func(int32_t fd, void* buf);
+extern int32_t lseek_func(int32_t fd, int32_t offset, int32_t whence);
+extern int32_t pread_func(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t readv_func(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+extern int32_t writev_func(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+extern int32_t sendfile_func(int32_t out_fd, int32_t in_fd, int32_t count);
 
 int32_t no_read(int32_t fd, void * buf, int32_t nbytes);
 int32_t no_write(int32_t fd, const void * buf, int32_t nbytes);
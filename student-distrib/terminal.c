@@ -138,6 +138,8 @@ int32_t init_term() {
 		clear_keyboard_backup(i);
 		term[i].has_enter = 0;
 		term[i].rtc_freq = MAX_RTC_FREQ;
+		/* only the first terminal is shown */
+		remap_vid(i, (i == 0) ? VIDEO : (int32_t)term[i].vid_backup);
 	}
 
 	curr_term = 0;		/* We launch the first terminal in the beginning */
@@ -179,11 +181,6 @@ int32_t launch_term(uint32_t term_id) {
 			return -1;	/* Switch the current terminal to new terminal */
 		}
 		curr_term = term_id;
-		uint8_t* screen_start;
-	    vidmap(&screen_start);
-	    if (running_term != curr_term) {
-	    	remap_vid((int32_t)screen_start, (int32_t)term[running_term].vid_backup);
-	    }
 		sti();
 	}
 	return 0;
@@ -204,6 +201,9 @@ int32_t switch_terminal(uint32_t old_term, uint32_t new_term) {
 		return -1;
 	if (restore_term_info(new_term) != 0)
 		return -1;
+	/* programs that used vidmap keep drawing where their terminal is */
+	remap_vid(old_term, (int32_t)term[old_term].vid_backup);
+	remap_vid(new_term, VIDEO);
 	return 0;
 }
 
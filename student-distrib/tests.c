@@ -7,6 +7,13 @@
 #include "keyboard.h"
 #include "rtc_handler.h"
 #include "file_system.h"
+#include "block_cache.h"
+#include "lz4.h"
+#include "mount.h"
+#include "crc32c.h"
+#include "page_alloc.h"
+#include "slab.h"
+#include "program_cache.h"
 #define PASS 1
 #define FAIL 0
 
@@ -826,6 +833,713 @@ int sys_rtc_test(){
 
 /* Checkpoint 5 tests */
 
+/* Test the hashed dentry index
+ * Every dentry found by index must be found by name with the same inode
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: filesystem
+ * Files: file_system.c/h
+ */
+int file_system_index_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t i;
+	dentry_t by_index, by_name;
+	uint8_t name[MAX_NAME_LENGTH+1];
+
+	for (i=0;i<root_fs->num_dentries;i++){
+		read_dentry_by_index(i,&by_index);
+		strncpy((int8_t*)name,by_index.file_name,MAX_NAME_LENGTH);
+		name[MAX_NAME_LENGTH] = '\0';
+		if (read_dentry_by_name(name,&by_name) != 0 || by_name.inode != by_index.inode){
+			printf("lookup failed: %s\n", name);
+			assertion_failure();
+			result = FAIL;
+		}
+	}
+	/* a missing name must probe to an empty slot and fail */
+	if (read_dentry_by_name((uint8_t*)"nonexistent",&by_name) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Test the getdents system call
+ * Calls until the end of the directory must return every entry in whole records
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: system call, filesystem
+ * Files: syscall_handler.c/h, file_system.c/h
+ */
+int getdents_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t fd, cnt, total = 0;
+	dirent_t records[MAX_DIR_ENTRIES];
+	
+	fd = open((uint8_t*)".");
+	/* a directory may have more entries than one call returns, 0 is the end */
+	while ((cnt = getdents(fd, records, sizeof(records))) > 0){
+		if (cnt % sizeof(dirent_t) != 0){
+			assertion_failure();
+			result = FAIL;
+		}
+		total += cnt;
+	}
+	if (cnt != 0 || total != root_fs->num_dentries*sizeof(dirent_t)){
+		assertion_failure();
+		result = FAIL;
+	}
+	/* a buffer too small for one record */
+	if (getdents(fd, records, sizeof(dirent_t)-1) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	return result;
+}
+
+/* Block cache Test
+ * 
+ * Asserts that every block read goes through the block cache
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: bread, read_data
+ * Files: block_cache.c/h, file_system.c/h
+ */
+int block_cache_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t buf[FOUR_KB];
+	uint32_t reads;
+	uint8_t* block;
+	dentry_t dentry;
+	
+	block = bread(root_fs->dev, 0);
+	if (block == NULL || bread(root_fs->dev, root_fs->dev->num_blocks) != NULL){
+		assertion_failure();
+		result = FAIL;
+	}
+	brelse(block);
+	/* the boot block and one data block at least */
+	reads = block_stats.hits + block_stats.misses;
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0 || read_data(dentry.inode, 0, buf, FOUR_KB) <= 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (block_stats.hits + block_stats.misses < reads + 2){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* File Write Test
+ *
+ * Asserts that a new file can be written, read back and truncated,
+ * needs an image built with createfs -w
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: adds write_test.txt to the image
+ * Coverage: create_file, write_data, truncate_data
+ * Files: file_system.c/h, block_cache.c/h
+ */
+int file_write_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t data[FOUR_KB+100];
+	uint8_t buf[FOUR_KB+100];
+	uint32_t i;
+	dentry_t dentry;
+
+	for (i=0;i<sizeof(data);i++){
+		data[i] = (uint8_t)(i*7) | 1;		/* no null byte, so strncmp compares it all */
+	}
+	if (create_file((uint8_t*)"write_test.txt") != 0 || read_dentry_by_name((uint8_t*)"write_test.txt", &dentry) != 0){
+		assertion_failure();
+		return FAIL;
+	}
+	/* two blocks, the second one only partly */
+	if (write_data(dentry.inode, 0, data, sizeof(data)) != sizeof(data) || file_length(dentry.inode) != sizeof(data)){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (read_data(dentry.inode, 0, buf, sizeof(buf)) != sizeof(buf) || strncmp((int8_t*)buf, (int8_t*)data, sizeof(data)) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (truncate_data(dentry.inode, 10) != 0 || read_data(dentry.inode, 0, buf, sizeof(buf)) != 10){
+		assertion_failure();
+		result = FAIL;
+	}
+	block_flush();
+	return result;
+}
+
+/* LZ4 Test
+ *
+ * Asserts that an LZ4 block with an overlapping match decompresses, and that
+ * a match reaching before the start of the data is rejected
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: lz4_decompress
+ * Files: lz4.c/h
+ */
+int lz4_test(){
+	TEST_HEADER;
+	int result = PASS;
+	/* "abc", then 9 bytes from 3 back, then the last literals "hello" */
+	uint8_t block[] = {0x35, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'h', 'e', 'l', 'l', 'o'};
+	uint8_t bad[] = {0x35, 'a', 'b', 'c', 0x04, 0x00, 0x50, 'h', 'e', 'l', 'l', 'o'};
+	uint8_t buf[32];
+
+	if (lz4_decompress(block, sizeof(block), buf, sizeof(buf)) != 17 || strncmp((int8_t*)buf, (int8_t*)"abcabcabcabchello", 17) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	/* too small for the data, and an offset past the data */
+	if (lz4_decompress(block, sizeof(block), buf, 16) != -1 || lz4_decompress(bad, sizeof(bad), buf, sizeof(buf)) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Tmpfs Test
+ *
+ * Asserts that a tmpfs file keeps what is written to it across opens
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: adds tmp/test to the tmpfs
+ * Coverage: tmpfs_create, tmpfs_read, tmpfs_write, open/create/truncate for tmpfs names
+ * Files: tmpfs.c/h, page_alloc.c/h, syscall_handler.c/h
+ */
+int tmpfs_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t data[FOUR_KB+100];
+	uint8_t buf[FOUR_KB+100];
+	int32_t fd;
+	uint32_t i;
+
+	for (i=0;i<sizeof(data);i++){
+		data[i] = (uint8_t)(i*3) | 1;
+	}
+	if (create((uint8_t*)"tmp/test") != 0 || (fd = open((uint8_t*)"tmp/test")) < 0){
+		assertion_failure();
+		return FAIL;
+	}
+	if (write(fd, data, sizeof(data)) != sizeof(data)){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	fd = open((uint8_t*)"tmp/test");
+	if (read(fd, buf, sizeof(buf)) != sizeof(buf) || strncmp((int8_t*)buf, (int8_t*)data, sizeof(data)) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (read(fd, buf, sizeof(buf)) != 0 || truncate(fd, 0) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	if (open((uint8_t*)"tmp/missing") != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Mount Test
+ *
+ * Asserts that a path is looked up on the image mounted at its longest prefix
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: mounts the root image a second time at mnt/
+ * Coverage: mount_add, mount_lookup, mount_image, read_dentry_by_name, read_data
+ * Files: mount.c/h, file_system.c/h
+ */
+int mount_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t buf[64];
+	uint8_t buf2[64];
+	dentry_t dentry, dentry2;
+	const uint8_t* name;
+	int32_t fs;
+
+	if (mount_lookup((uint8_t*)"frame0.txt", MOUNT_IMAGE, &name) != FS_ROOT || mount_lookup((uint8_t*)"tmp/a", MOUNT_IMAGE, &name) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	if ((fs = mount_image((uint8_t*)"mnt/", root_fs->dev)) <= FS_ROOT){
+		assertion_failure();
+		return FAIL;
+	}
+	/* the same file on both mounts has different ids but the same data */
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0 || read_dentry_by_name((uint8_t*)"mnt/frame0.txt", &dentry2) != 0
+		|| ID_FS(dentry2.inode) != fs || ID_INODE(dentry2.inode) != dentry.inode){
+		assertion_failure();
+		return FAIL;
+	}
+	if (read_data(dentry.inode, 0, buf, sizeof(buf)) != sizeof(buf) || read_data(dentry2.inode, 0, buf2, sizeof(buf2)) != sizeof(buf2)
+		|| strncmp((int8_t*)buf, (int8_t*)buf2, sizeof(buf)) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (read_dentry_by_name((uint8_t*)"mnt/missing", &dentry2) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Stat Test
+ *
+ * Asserts that stat and fstat report the same type and length as the directory
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: stat_func, fstat_func
+ * Files: syscall_handler.c/h
+ */
+int stat_test(){
+	TEST_HEADER;
+	int result = PASS;
+	stat_t st, fst;
+	dentry_t dentry;
+	int32_t fd;
+
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0 || stat((uint8_t*)"frame0.txt", &st) != 0
+		|| st.file_type != 2 || st.inode != dentry.inode || st.size != file_length(dentry.inode)){
+		assertion_failure();
+		return FAIL;
+	}
+	fd = open((uint8_t*)"frame0.txt");
+	if (fstat(fd, &fst) != 0 || fst.size != st.size || fst.inode != st.inode){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	if (stat((uint8_t*)".", &st) != 0 || st.file_type != 1 || st.size != 0 || stat((uint8_t*)"missing", &st) != -1 || fstat(1, &st) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Seek Test
+ *
+ * Asserts that lseek, pread and readv see the same bytes as plain reads
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: lseek_func, pread_func, readv_func
+ * Files: syscall_handler.c/h, interrupt_handler.S
+ */
+int seek_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t whole[300];
+	uint8_t buf[300];
+	iovec_t iov[2];
+	int32_t fd;
+
+	fd = open((uint8_t*)"frame0.txt");
+	if (fd < 0 || read(fd, whole, sizeof(whole)) != sizeof(whole)){
+		assertion_failure();
+		return FAIL;
+	}
+	/* pread doesn't move the position */
+	if (pread(fd, buf, 50, 100) != 50 || strncmp((int8_t*)buf, (int8_t*)whole+100, 50) != 0 || lseek(fd, 0, SEEK_CUR) != sizeof(whole)){
+		assertion_failure();
+		result = FAIL;
+	}
+	iov[0].base = buf;
+	iov[0].length = 10;
+	iov[1].base = buf+10;
+	iov[1].length = 90;
+	if (lseek(fd, 200, SEEK_SET) != 200 || readv(fd, iov, 2) != 100 || strncmp((int8_t*)buf, (int8_t*)whole+200, 100) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (lseek(fd, 0, SEEK_END) != file_length(get_specific_pcb(cur_pid)->fd_table[fd].inode) || read(fd, buf, 1) != 0 || lseek(fd, -1000000, SEEK_CUR) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	return result;
+}
+
+/* Sendfile Test
+ *
+ * Asserts that sendfile copies a whole file into a tmpfs file
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: adds tmp/copy to the tmpfs
+ * Coverage: sendfile_func
+ * Files: syscall_handler.c/h
+ */
+int sendfile_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t buf[200];
+	uint8_t buf2[200];
+	int32_t in, out, length;
+
+	in = open((uint8_t*)"frame0.txt");
+	if (in < 0 || create((uint8_t*)"tmp/copy") != 0 || (out = open((uint8_t*)"tmp/copy")) < 0){
+		assertion_failure();
+		return FAIL;
+	}
+	length = file_length(get_specific_pcb(cur_pid)->fd_table[in].inode);
+	if (sendfile(out, in, length+100) != length || sendfile(out, in, 100) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (pread(in, buf, sizeof(buf), 0) != sizeof(buf) || pread(out, buf2, sizeof(buf2), 0) != sizeof(buf2)
+		|| strncmp((int8_t*)buf, (int8_t*)buf2, sizeof(buf)) != 0){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(in);
+	close(out);
+	return result;
+}
+
+/* Path Test
+ *
+ * Asserts that paths resolve one directory at a time, and that every entry
+ * of a subdirectory is found again under "dir/name"
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: read_dentry_by_name, read_dentry_in_dir
+ * Files: file_system.c/h
+ */
+int path_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t path[2*MAX_NAME_LENGTH+2];
+	dentry_t dentry, dentry2, entry;
+	uint32_t i, j, length;
+
+	/* "." of the root stays in the root, a file can't be walked into */
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0 || read_dentry_by_name((uint8_t*)".//frame0.txt", &dentry2) != 0
+		|| dentry.inode != dentry2.inode || read_dentry_by_name((uint8_t*)"frame0.txt/x", &dentry2) != -1){
+		assertion_failure();
+		return FAIL;
+	}
+	for (i=0;read_dentry_by_index(i, &dentry) == 0;i++){
+		if (dentry.file_type != 1 || dentry.inode == 0){
+			continue;
+		}
+		for (j=0;read_dentry_in_dir(dentry.inode, j, &entry) == 0;j++){
+			length = strlen((int8_t*)dentry.file_name);
+			length = length > MAX_NAME_LENGTH ? MAX_NAME_LENGTH : length;
+			strncpy((int8_t*)path, dentry.file_name, length);
+			path[length] = '/';
+			strncpy((int8_t*)path+length+1, entry.file_name, MAX_NAME_LENGTH);
+			path[length+1+MAX_NAME_LENGTH] = '\0';
+			if (read_dentry_by_name(path, &dentry2) != 0 || dentry2.inode != entry.inode){
+				assertion_failure();
+				result = FAIL;
+			}
+		}
+	}
+	return result;
+}
+
+/* Checksum Test
+ *
+ * Asserts that CRC32C matches its check value, and that an image with a
+ * checksum table had every covered block verified at mount without a bad one
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: crc32c, verify_image, fs_check
+ * Files: crc32c.c/h, file_system.c/h
+ */
+int checksum_test(){
+	TEST_HEADER;
+	int result = PASS;
+	const fs_check_t* check;
+
+	if (crc32c((uint8_t*)"123456789", 9) != 0xE3069283){
+		assertion_failure();
+		result = FAIL;
+	}
+	check = fs_check(FS_ROOT);
+	if (check != NULL && (check->bad_blocks != 0
+		|| check->checked_blocks != root_fs->boot_block.num_inodes + root_fs->boot_block.checksum_table)){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Frame Allocator Test
+ *
+ * Asserts that blocks of several orders are aligned on their size, and that
+ * once freed the buddies merge back so the free counts are what they were
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: frame_alloc, frame_free, frame_stats
+ * Files: page_alloc.c/h
+ */
+int frame_alloc_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t orders[3] = {0, KERNEL_BLOCK_ORDER, FRAME_ORDER_4MB};
+	uint32_t addr[3];
+	uint32_t kernel_free = frame_stats(ZONE_KERNEL)->free;
+	uint32_t user_free = frame_stats(ZONE_USER)->free;
+	int i;
+
+	for (i = 0; i < 3; i++){
+		addr[i] = frame_alloc(orders[i], FRAME_KERNEL);
+		if (addr[i] == 0 || addr[i] % (FRAME_SIZE << orders[i]) != 0 || addr[i] >= KERNEL_MAP_LIMIT){
+			assertion_failure();
+			result = FAIL;
+		}
+	}
+	for (i = 0; i < 3; i++){
+		frame_free(addr[i]);
+	}
+	/* a second free is ignored */
+	frame_free(addr[0]);
+	if (frame_stats(ZONE_KERNEL)->free != kernel_free || frame_stats(ZONE_USER)->free != user_free){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Slab Test
+ *
+ * Asserts that kmalloc of every size class is aligned on a cache line, that
+ * a size past KMALLOC_MAX fails, and that kfree gives every object back
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: kmalloc, kfree, kmem_stats
+ * Files: slab.c/h
+ */
+int slab_test(){
+	TEST_HEADER;
+	int result = PASS;
+	const kmem_stats_t* stats;
+	uint32_t size, active[MAX_CACHES];
+	uint8_t* obj;
+	int i;
+
+	for (i = 0; i < MAX_CACHES; i++){
+		stats = kmem_stats(i);
+		active[i] = (stats != NULL) ? stats->active : 0;
+	}
+	for (size = 1; size <= KMALLOC_MAX; size *= 3){
+		obj = kmalloc(size);
+		if (obj == NULL || (uint32_t)obj % CACHE_LINE != 0){
+			assertion_failure();
+			result = FAIL;
+			continue;
+		}
+		memset(obj, 0, size);
+		kfree(obj);
+	}
+	if (kmalloc(KMALLOC_MAX + 1) != NULL){
+		assertion_failure();
+		result = FAIL;
+	}
+	for (i = 0; i < MAX_CACHES; i++){
+		stats = kmem_stats(i);
+		if (stats != NULL && stats->active != active[i]){
+			assertion_failure();
+			result = FAIL;
+		}
+	}
+	return result;
+}
+
+/* Page Directory Test
+ *
+ * Asserts that a new page directory shares the kernel entries, global past
+ * the first 4MB page, and maps nothing of the user part
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: new_directory, free_directory
+ * Files: paging.c/h
+ */
+int directory_test(){
+	TEST_HEADER;
+	int result = PASS;
+	PD_t* directory = new_directory();
+	int i;
+
+	if (directory == NULL){
+		assertion_failure();
+		return FAIL;
+	}
+	for (i = 0; i < NUMBER_ENTRIES; i++){
+		if (i < KERNEL_MAP_END_PDE && (directory->page_directory[i].mb.pointer != page_directory_array[0].page_directory[i].mb.pointer
+			|| (i >= KERNEL_MAP_PDE && !directory->page_directory[i].mb.g))){
+			assertion_failure();
+			result = FAIL;
+		}
+		if (i >= KERNEL_MAP_END_PDE && directory->page_directory[i].mb.p){
+			assertion_failure();
+			result = FAIL;
+		}
+	}
+	free_directory(directory);
+	return result;
+}
+
+/* TLB Test
+ *
+ * Asserts that global pages are enabled, and that invalidating one kernel
+ * page is counted without a full flush
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: flush_page, tlb_stats
+ * Files: paging.c/h
+ */
+int tlb_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t cr4, full = tlb_stats.full_flushes, pages = tlb_stats.page_flushes;
+
+	asm volatile("movl %%cr4, %0;" :"=r"(cr4));
+	if (!(cr4 & 0x80)){
+		assertion_failure();
+		result = FAIL;
+	}
+	flush_page(VIDEO);
+	if (tlb_stats.page_flushes != pages + 1 || tlb_stats.full_flushes != full){
+		assertion_failure();
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Mmap Test
+ *
+ * Asserts that mmap maps frame0.txt read-only with the bytes read_data
+ * returns, and that munmap takes its pages out of the mmap window again
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: mmap_func, munmap_func, file_block_addr
+ * Files: syscall_handler.c/h, file_system.c/h
+ */
+int mmap_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint8_t buf[FOUR_KB];
+	uint32_t cr3, length, page;
+	int32_t fd, addr;
+	PD_t* directory;
+	PT_t* table;
+	dentry_t dentry;
+
+	fd = open((uint8_t*)"frame0.txt");
+	if (fd < 0 || read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0){
+		assertion_failure();
+		return FAIL;
+	}
+	length = file_length(dentry.inode);
+	addr = mmap(fd);
+	if (addr == -1 || length > sizeof(buf) || read_data(dentry.inode, 0, buf, length) != length
+		|| strncmp((int8_t*)addr, (int8_t*)buf, length) != 0){
+		assertion_failure();
+		close(fd);
+		return FAIL;
+	}
+	/* the window of the current process, the table mmap took for it */
+	asm volatile("movl %%cr3, %0;" :"=r"(cr3));
+	directory = (PD_t*)(cr3 & ~(FOUR_KB-1));
+	table = (PT_t*)(directory->page_directory[MMAP_ADDR/_4MB].kb.page_table_base_addr << shift);
+	page = (addr - MMAP_ADDR)/FOUR_KB;
+	if (!table->page_table[page].p || table->page_table[page].rw){
+		assertion_failure();
+		result = FAIL;
+	}
+	if (munmap((void*)addr) != 0 || table->page_table[page].p || munmap((void*)addr) != -1){
+		assertion_failure();
+		result = FAIL;
+	}
+	close(fd);
+	return result;
+}
+
+/* Program Cache Test
+ *
+ * Asserts that two instances of ls share one cache slot and its frames,
+ * that dropping the program while it runs only marks the slot stale, and
+ * that the last put of a stale slot gives its frames back
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: program_cache_get, program_cache_page, program_cache_drop, program_cache_put
+ * Files: program_cache.c/h
+ */
+int program_cache_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t first, second, fresh;
+	uint32_t size, frame, free;
+	dentry_t dentry;
+
+	if (read_dentry_by_name((uint8_t*)"ls", &dentry) != 0 || (size = file_length(dentry.inode)) == 0){
+		assertion_failure();
+		return FAIL;
+	}
+	/* start from a slot nobody else has loaded */
+	program_cache_drop(dentry.inode);
+	first = program_cache_get(dentry.inode, size);
+	second = program_cache_get(dentry.inode, size);
+	frame = program_cache_page(first, 0);
+	if (first < 0 || second != first || frame == PROGRAM_NO_FRAME || program_cache_page(second, 0) != frame){
+		assertion_failure();
+		program_cache_put(first);
+		program_cache_put(second);
+		return FAIL;
+	}
+	
+	/* a stale slot is never handed out again, a new instance gets a slot of its own */
+	program_cache_drop(dentry.inode);
+	fresh = program_cache_get(dentry.inode, size);
+	if (fresh < 0 || fresh == first){
+		assertion_failure();
+		result = FAIL;
+	}
+	program_cache_put(fresh);
+	
+	/* the frames outlive the first put and go back with the last one */
+	free = free_pages();
+	program_cache_put(first);
+	if (free_pages() != free || program_cache_page(second, 0) != frame){
+		assertion_failure();
+		result = FAIL;
+	}
+	program_cache_put(second);
+	if (free_pages() != free + 1){
+		assertion_failure();
+		result = FAIL;
+	}
+	program_cache_drop(dentry.inode);
+	return result;
+}
+
 
 /* Test suite entry point */
 void launch_tests(){
@@ -847,6 +1561,24 @@ void launch_tests(){
 	//TEST_OUTPUT("open and close test",open_close_test());
 	//TEST_OUTPUT("system call read/write test for file/dir",sys_read_test1());
 	//TEST_OUTPUT("system call read/write test for rtc",sys_rtc_test());
+	//TEST_OUTPUT("file_system_index_test",file_system_index_test());
+	//TEST_OUTPUT("getdents_test",getdents_test());
+	//TEST_OUTPUT("block_cache_test",block_cache_test());
+	//TEST_OUTPUT("file_write_test",file_write_test());
+	//TEST_OUTPUT("tmpfs_test",tmpfs_test());
+	//TEST_OUTPUT("lz4_test",lz4_test());
+	//TEST_OUTPUT("mount_test",mount_test());
+	//TEST_OUTPUT("stat_test",stat_test());
+	//TEST_OUTPUT("seek_test",seek_test());
+	//TEST_OUTPUT("sendfile_test",sendfile_test());
+	//TEST_OUTPUT("path_test",path_test());
+	//TEST_OUTPUT("checksum_test",checksum_test());
+	//TEST_OUTPUT("frame_alloc_test",frame_alloc_test());
+	//TEST_OUTPUT("slab_test",slab_test());
+	//TEST_OUTPUT("directory_test",directory_test());
+	//TEST_OUTPUT("tlb_test",tlb_test());
+	//TEST_OUTPUT("mmap_test",mmap_test());
+	//TEST_OUTPUT("program_cache_test",program_cache_test());
 	TEST_OUTPUT("shell_test",shell_test());
     
 
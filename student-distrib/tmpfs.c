@@ -0,0 +1,207 @@
+/* tmpfs.c - files kept in memory, mounted under the "tmp/" prefix next to the file system images,
+ *			 they are lost at reboot
+ */
+#include "tmpfs.h"
+#include "mount.h"
+#include "page_alloc.h"
+#include "syscall_handler.h"
+#include "lib.h"
+
+static tmpfs_node_t tmpfs_nodes[TMPFS_MAX_FILES];
+
+/* const uint8_t* tmpfs_name()
+ * Task: check whether a file name is on the tmpfs
+ * Input : filename----the name given to open or create
+ * Output: the name inside the tmpfs, NULL if it isn't a tmpfs name
+ */
+const uint8_t* tmpfs_name(const uint8_t* filename){
+	const uint8_t* name;
+	
+	if (mount_lookup(filename, MOUNT_TMPFS, &name) < 0){
+		return NULL;
+	}
+	return name;
+}
+
+/* int32_t tmpfs_lookup()
+ * Task: find a tmpfs file by name
+ * Input : name----the name without the prefix
+ * Output: the node of the file, -1 if it doesn't exist
+ */
+int32_t tmpfs_lookup(const uint8_t* name){
+	uint32_t length = strlen((const int8_t*)name);
+	int32_t i;
+	
+	if (length == 0 || length > TMPFS_MAX_NAME){
+		return -1;
+	}
+	for (i=0;i<TMPFS_MAX_FILES;i++){
+		if (tmpfs_nodes[i].used && strncmp(tmpfs_nodes[i].name, (const int8_t*)name, TMPFS_MAX_NAME) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* int32_t tmpfs_create()
+ * Task: make an empty tmpfs file, an existing one is truncated to 0
+ * Input : name----the name without the prefix
+ * Output: the node of the file, -1 if the name is invalid or every node is used
+ */
+int32_t tmpfs_create(const uint8_t* name){
+	uint32_t length = strlen((const int8_t*)name);
+	int32_t i;
+	
+	if (length == 0 || length > TMPFS_MAX_NAME){
+		return -1;
+	}
+	i = tmpfs_lookup(name);
+	if (i >= 0){
+		tmpfs_truncate(i, 0);
+		return i;
+	}
+	for (i=0;i<TMPFS_MAX_FILES;i++){
+		if (!tmpfs_nodes[i].used){
+			memset(&tmpfs_nodes[i], 0, sizeof(tmpfs_node_t));
+			strncpy(tmpfs_nodes[i].name, (const int8_t*)name, TMPFS_MAX_NAME);
+			tmpfs_nodes[i].used = 1;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* int32_t tmpfs_truncate()
+ * Task: cut a tmpfs file down to length, the pages past the new end go back to the pool
+ * Input : node-----the node of the file
+ *		   length---the new length, at most the current one
+ * Output: success return 0, otherwise return -1
+ */
+int32_t tmpfs_truncate(uint32_t node, uint32_t length){
+	tmpfs_node_t* file;
+	uint32_t page;
+	
+	if (node >= TMPFS_MAX_FILES || !tmpfs_nodes[node].used || length > tmpfs_nodes[node].length){
+		return -1;
+	}
+	file = &tmpfs_nodes[node];
+	for (page=(length+four_KB-1)/four_KB;page<TMPFS_MAX_PAGES;page++){
+		free_page(file->pages[page]);
+		file->pages[page] = NULL;
+	}
+	/* the rest of the last page reads as zero if the file grows again */
+	if (length%four_KB != 0 && file->pages[length/four_KB] != NULL){
+		memset(file->pages[length/four_KB] + length%four_KB, 0, four_KB - length%four_KB);
+	}
+	file->length = length;
+	return 0;
+}
+
+/* uint32_t tmpfs_length()
+ * Task: get the length of a tmpfs file
+ * Input : node----the node of the file
+ * Output: the length in bytes
+ */
+uint32_t tmpfs_length(uint32_t node){
+	return (node < TMPFS_MAX_FILES) ? tmpfs_nodes[node].length : 0;
+}
+
+/* int32_t tmpfs_open(): initialize any temporary structures
+ * Input:  filename
+ * Output: return 0
+ */
+int32_t tmpfs_open (const uint8_t* filename){
+	return 0;
+}
+
+/* int32_t tmpfs_close(): undo what you did in the open function
+ * Input:  fd
+ * Output: return 0
+ */
+int32_t tmpfs_close (int32_t fd){
+	return 0;
+}
+
+/* int32_t tmpfs_read(): copy from the file position into buf, one memcpy per page
+ * Input : fd		--	file descriptor
+ *		   buf		--	the buffer
+ *		   nbytes	--	number of bytes to read
+ * Output: return the number of bytes read, 0 at the end of the file, -1 on failure
+ */
+int32_t tmpfs_read (int32_t fd, void* buf, int32_t nbytes){
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	tmpfs_node_t* file = &tmpfs_nodes[pcb->fd_table[fd].inode];
+	uint32_t position = pcb->fd_table[fd].file_position;
+	uint32_t copied, span, line;
+	uint8_t* page;
+	
+	if (buf == NULL || nbytes < 0){
+		return -1;
+	}
+	if (position >= file->length){
+		return 0;
+	}
+	if ((uint32_t)nbytes > file->length - position){
+		nbytes = file->length - position;
+	}
+	for (copied=0;copied<(uint32_t)nbytes;copied+=span){
+		line = (position+copied)%four_KB;
+		span = four_KB - line;
+		if (span > nbytes-copied){
+			span = nbytes-copied;
+		}
+		page = file->pages[(position+copied)/four_KB];
+		if (page == NULL){
+			memset((uint8_t*)buf+copied, 0, span);
+		}
+		else{
+			memcpy((uint8_t*)buf+copied, page+line, span);
+		}
+	}
+	pcb->fd_table[fd].file_position += copied;
+	return copied;
+}
+
+/* int32_t tmpfs_write(): copy buf to the file position, pages are allocated as the file grows
+ * Input : fd		--	file descriptor
+ *		   buf		--	the data
+ *		   nbytes	--	number of bytes to write
+ * Output: return the number of bytes written, less than nbytes once the file or the pool is full,
+ *		   -1 if nothing could be written
+ */
+int32_t tmpfs_write (int32_t fd, const void* buf, int32_t nbytes){
+	pcb_t* pcb = get_specific_pcb(cur_pid);
+	tmpfs_node_t* file = &tmpfs_nodes[pcb->fd_table[fd].inode];
+	uint32_t position = pcb->fd_table[fd].file_position;
+	uint32_t copied, span, line, index;
+	
+	if (buf == NULL || nbytes < 0){
+		return -1;
+	}
+	for (copied=0;copied<(uint32_t)nbytes;copied+=span){
+		index = (position+copied)/four_KB;
+		if (index >= TMPFS_MAX_PAGES){
+			break;
+		}
+		if (file->pages[index] == NULL){
+			if ((file->pages[index] = alloc_page()) == NULL){
+				break;
+			}
+			memset(file->pages[index], 0, four_KB);
+		}
+		line = (position+copied)%four_KB;
+		span = four_KB - line;
+		if (span > nbytes-copied){
+			span = nbytes-copied;
+		}
+		memcpy(file->pages[index]+line, (const uint8_t*)buf+copied, span);
+	}
+	if (copied == 0 && nbytes > 0){
+		return -1;
+	}
+	pcb->fd_table[fd].file_position += copied;
+	if (position+copied > file->length){
+		file->length = position+copied;
+	}
+	return copied;
+}
@@ -0,0 +1,34 @@
+/* tmpfs.h - Defines for tmpfs.c
+ *			 used to keep scratch files in memory
+ */
+
+#ifndef _TMPFS_H
+#define _TMPFS_H
+
+#include "types.h"
+
+#define TMPFS_PREFIX "tmp/"				// where the tmpfs is mounted, see mount.h
+#define TMPFS_MAX_NAME 32
+#define TMPFS_MAX_FILES 32
+#define TMPFS_MAX_PAGES 256				// 1MB per file
+
+/* new struct to store one tmpfs file, the data lives in pages from alloc_page */
+typedef struct tmpfs_node{
+	int8_t name[TMPFS_MAX_NAME];		// without the prefix, not null terminated if 32 long
+	uint32_t used;						// 1->the file exists, 0->free slot
+	uint32_t length;
+	uint8_t* pages[TMPFS_MAX_PAGES];	// NULL for pages never written, they read as zero
+} tmpfs_node_t;
+
+extern const uint8_t* tmpfs_name(const uint8_t* filename);
+extern int32_t tmpfs_lookup(const uint8_t* name);
+extern int32_t tmpfs_create(const uint8_t* name);
+extern int32_t tmpfs_truncate(uint32_t node, uint32_t length);
+extern uint32_t tmpfs_length(uint32_t node);
+
+extern int32_t tmpfs_open (const uint8_t* filename);
+extern int32_t tmpfs_read (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t tmpfs_write (int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t tmpfs_close (int32_t fd);
+
+#endif /* _TMPFS_H */
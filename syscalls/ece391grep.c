@@ -4,12 +4,37 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
-#define SBUFSIZE 33
+#define NUM_RECORDS 64
 
+/* search a file that has been mapped with mmap, without copying it */
 int32_t
-do_one_file (const char* s, const char* fname) 
+do_mapped_file (const char* s, const char* fname, const uint8_t* data, int32_t size)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
+    int32_t line_start, line_end, check, s_len;
+
+    s_len = ece391_strlen ((uint8_t*)s);
+    for (line_start = 0; line_start < size; line_start = line_end + 1) {
+        line_end = line_start;
+        while (line_end < size && '\n' != data[line_end])
+            line_end++;
+        for (check = line_start; check + s_len <= line_end; check++) {
+            if (s[0] == data[check] &&
+                0 == ece391_strncmp (data + check, (uint8_t*)s, s_len)) {
+                ece391_fdputs (1, (uint8_t*)fname);
+                ece391_fdputs (1, (uint8_t*)":");
+                (void)ece391_write (1, data + line_start, line_end - line_start);
+                ece391_fdputs (1, (uint8_t*)"\n");
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname, int32_t size)
+{
+    int32_t fd, cnt, last, line_start, line_end, check, s_len, addr;
     uint8_t data[BUFSIZE+1];
 
     s_len = ece391_strlen ((uint8_t*)s);
@@ -17,6 +42,11 @@ do_one_file (const char* s, const char* fname)
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
+    if (-1 != (addr = ece391_mmap (fd))) {
+        (void)do_mapped_file (s, fname, (uint8_t*)addr, size);
+        (void)ece391_munmap ((void*)addr);
+        return ece391_close (fd);
+    }
     last = 0;
     while (1) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
@@ -67,8 +97,8 @@ do_one_file (const char* s, const char* fname)
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i;
+    ece391_dirent_t records[NUM_RECORDS];
     uint8_t search[BUFSIZE];
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
@@ -81,16 +111,18 @@ int main ()
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    while (0 != (cnt = ece391_getdents (fd, records, sizeof (records)))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (i = 0; i < cnt / (int32_t)sizeof (ece391_dirent_t); i++) {
+	    if (2 != records[i].file_type) /* a directory or the rtc... */
+		continue;
+	    if (0 != do_one_file ((char*)search, (char*)records[i].name,
+                                  records[i].size))
+		return 3;
+	}
     }
 
     return 0;
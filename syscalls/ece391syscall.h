@@ -22,6 +22,83 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * getdents fills buf with as many directory records as fit and returns
+ * the number of bytes filled, 0 once the whole directory has been read.
+ */
+#define ECE391_NAME_LEN 32
+
+typedef struct ece391_dirent {
+	uint32_t inode;
+	uint32_t file_type;   /* 0 rtc, 1 directory, 2 regular file */
+	uint32_t size;        /* file length, 0 for rtc and directories */
+	int8_t name[ECE391_NAME_LEN + 1];
+	uint8_t reserved[3];
+} ece391_dirent_t;
+
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+
+/*
+ * mmap maps an open regular file read-only and returns the address of its
+ * first byte (-1 on failure); bytes past the end of the file are undefined.
+ */
+extern int32_t ece391_mmap (int32_t fd);
+extern int32_t ece391_munmap (void* addr);
+
+/*
+ * create makes an empty file (an existing one is truncated to 0) on a
+ * writable image; write stores data at the file position and grows the
+ * file as needed. truncate cuts an open file down to length bytes.
+ * Names starting with "tmp/" are files kept in memory until reboot,
+ * they can always be created and written. New files on an image only go
+ * to its root directory; open and execute also take "dir/sub/name" paths.
+ */
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_truncate (int32_t fd, uint32_t length);
+
+/*
+ * stat fills buf with the inode, type and length of a named file, fstat
+ * does the same for an open one (not for the terminal), so a file can be
+ * read whole into a buffer of the right size with one read.
+ */
+typedef struct ece391_stat {
+	uint32_t inode;
+	uint32_t file_type;   /* 0 rtc, 1 directory, 2 regular file */
+	uint32_t size;        /* file length, 0 for rtc and directories */
+} ece391_stat_t;
+
+extern int32_t ece391_stat (const uint8_t* filename, ece391_stat_t* buf);
+extern int32_t ece391_fstat (int32_t fd, ece391_stat_t* buf);
+
+/*
+ * lseek moves the position of an open file (whence 0 from the start, 1 from
+ * the position, 2 from the end) and returns it; a directory position is an
+ * entry index. pread reads at offset without moving the position. readv
+ * and writev move up to 16 buffers in one call, filling each one before
+ * the next, and stop at the first short transfer.
+ */
+#define ECE391_SEEK_SET 0
+#define ECE391_SEEK_CUR 1
+#define ECE391_SEEK_END 2
+
+typedef struct ece391_iovec {
+	void* base;
+	int32_t length;
+} ece391_iovec_t;
+
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_readv (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+
+/*
+ * sendfile copies up to count bytes from the position of the regular or
+ * tmpfs file in_fd to out_fd (the terminal or any writable file) without
+ * passing through user memory, and returns the number copied, 0 at the
+ * end of the file.
+ */
+extern int32_t ece391_sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,